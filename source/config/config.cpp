@@ -52,6 +52,18 @@ void Config::loadConfiguration()
         theConfig.insert("PaletteSelectionBorderColor", "#FF0000");
         configurationModified = true;
     }
+    if (!theConfig.contains("DecodedFramesLimit")) {
+        theConfig.insert("DecodedFramesLimit", 256); // MB
+        configurationModified = true;
+    }
+    if (!theConfig.contains("FrameImageCacheLimit")) {
+        theConfig.insert("FrameImageCacheLimit", 64); // MB
+        configurationModified = true;
+    }
+    if (!theConfig.contains("OptimalCl2Encoding")) {
+        theConfig.insert("OptimalCl2Encoding", false);
+        configurationModified = true;
+    }
 
     if (configurationModified) {
         Config::storeConfiguration();
@@ -1,42 +1,39 @@
 #include "d1amp.h"
 
-#include <QBuffer>
-#include <QDataStream>
+#include <algorithm>
+
 #include <QDebug>
 #include <QFile>
-#include <QFileInfo>
 #include <QMessageBox>
 
+#include "d1dataview.h"
+
+// type and properties of a tile
+#define AMP_ENTRY_SIZE 2
+
 bool D1Amp::load(QString filePath, int tileCount, const OpenAsParam &params)
 {
-    // prepare file data source
-    QFile file;
+    // prepare file data source (memory-mapped)
+    D1FileData file;
     // done by the caller
     // if (!params.ampFilePath.isEmpty()) {
     //    filePath = params.ampFilePath;
     // }
     if (!filePath.isEmpty()) {
-        file.setFileName(filePath);
-        if (!file.open(QIODevice::ReadOnly) && !params.ampFilePath.isEmpty()) {
+        if (!file.open(filePath) && !params.ampFilePath.isEmpty()) {
             return false; // report read-error only if the file was explicitly requested
         }
     }
-
-    QByteArray fileData = file.readAll();
-    QBuffer fileBuffer(&fileData);
-
-    if (!fileBuffer.open(QIODevice::ReadOnly)) {
-        return false;
-    }
+    const D1DataView in = file.view();
 
     // File size check
-    auto fileSize = file.size();
-    if (fileSize % 2 != 0) {
+    auto fileSize = in.size();
+    if (fileSize % AMP_ENTRY_SIZE != 0) {
         qDebug() << "Invalid amp-file.";
         return false;
     }
 
-    int ampTileCount = fileSize / 2;
+    int ampTileCount = fileSize / AMP_ENTRY_SIZE;
     if (ampTileCount != tileCount) {
         if (ampTileCount != 0) {
             qDebug() << "The size of amp-file does not align with til-file";
@@ -46,25 +43,9 @@ bool D1Amp::load(QString filePath, int tileCount, const OpenAsParam &params)
         }
     }
 
-    // prepare empty lists with zeros
-    this->properties.clear();
-    this->types.clear();
-    for (int i = 0; i < tileCount; i++) {
-        this->types.append(0);
-        this->properties.append(0);
-    }
-
-    // Read AMP binary data
-    QDataStream in(&fileBuffer);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    for (int i = 0; i < ampTileCount; i++) {
-        quint8 readBytr;
-        in >> readBytr;
-        this->types[i] = readBytr;
-        in >> readBytr;
-        this->properties[i] = readBytr;
-    }
+    // Read AMP binary data in one go (the missing tiles are zero)
+    this->tileEntries.assign((size_t)tileCount * AMP_ENTRY_SIZE, 0);
+    std::copy_n(in.data(), ampTileCount * AMP_ENTRY_SIZE, this->tileEntries.begin());
 
     this->ampFilePath = filePath;
     this->modified = false;
@@ -84,11 +65,7 @@ bool D1Amp::save(const QString &gfxPath)
     }
 
     // write to file
-    QDataStream out(&outFile);
-    for (int i = 0; i < this->types.size(); i++) {
-        out << this->types[i];
-        out << this->properties[i];
-    }
+    outFile.write(reinterpret_cast<const char *>(this->tileEntries.data()), this->tileEntries.size());
 
     this->ampFilePath = filePath;
     this->modified = false;
@@ -108,42 +85,47 @@ QString D1Amp::getFilePath()
 
 quint8 D1Amp::getTileType(quint16 tileIndex)
 {
-    if (tileIndex >= this->types.count())
+    if ((size_t)tileIndex * AMP_ENTRY_SIZE >= this->tileEntries.size())
         return 0;
 
-    return this->types.at(tileIndex);
+    return this->tileEntries[(size_t)tileIndex * AMP_ENTRY_SIZE];
 }
 
 quint8 D1Amp::getTileProperties(quint16 tileIndex)
 {
-    if (tileIndex >= this->properties.count())
+    if ((size_t)tileIndex * AMP_ENTRY_SIZE >= this->tileEntries.size())
         return 0;
 
-    return this->properties.at(tileIndex);
+    return this->tileEntries[(size_t)tileIndex * AMP_ENTRY_SIZE + 1];
 }
 
 void D1Amp::setTileType(quint16 tileIndex, quint8 value)
 {
-    this->types[tileIndex] = value;
+    this->tileEntries[(size_t)tileIndex * AMP_ENTRY_SIZE] = value;
     this->modified = true;
 }
 
 void D1Amp::setTileProperties(quint16 tileIndex, quint8 value)
 {
-    this->properties[tileIndex] = value;
+    this->tileEntries[(size_t)tileIndex * AMP_ENTRY_SIZE + 1] = value;
     this->modified = true;
 }
 
 void D1Amp::createTile()
 {
-    this->types.append(0);
-    this->properties.append(0);
+    this->tileEntries.resize(this->tileEntries.size() + AMP_ENTRY_SIZE, 0);
     this->modified = true;
 }
 
 void D1Amp::removeTile(int tileIndex)
 {
-    this->types.removeAt(tileIndex);
-    this->properties.removeAt(tileIndex);
+    auto entry = this->tileEntries.begin() + (size_t)tileIndex * AMP_ENTRY_SIZE;
+    this->tileEntries.erase(entry, entry + AMP_ENTRY_SIZE);
+    this->modified = true;
+}
+
+void D1Amp::remapTiles(const D1IndexRemap &remap)
+{
+    D1Remap::moveEntries(this->tileEntries, remap, AMP_ENTRY_SIZE);
     this->modified = true;
 }
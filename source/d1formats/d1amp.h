@@ -1,8 +1,11 @@
 #pragma once
 
+#include <vector>
+
 #include <QList>
 #include <QString>
 
+#include "d1remap.h"
 #include "dialogs/openasdialog.h"
 
 class D1Amp : public QObject {
@@ -23,10 +26,11 @@ public:
     void setTileProperties(quint16 tileIndex, quint8 value);
     void createTile();
     void removeTile(int tileIndex);
+    void remapTiles(const D1IndexRemap &remap);
 
 private:
     bool modified;
     QString ampFilePath;
-    QList<quint8> types;
-    QList<quint8> properties;
+    // type and properties of the tiles as stored in the file
+    std::vector<quint8> tileEntries;
 };
@@ -1,102 +1,81 @@
 #include "d1cel.h"
 
-#include <QBuffer>
 #include <QByteArray>
-#include <QDataStream>
 #include <QList>
 #include <QMessageBox>
 
+#include <memory>
+
 #include "d1celframe.h"
+#include "d1dataview.h"
+#include "d1filewriter.h"
+
+// number of frames used to infer the width of a headerless CEL
+#define CEL_WIDTH_SAMPLE_FRAMES 4
 
 bool D1Cel::load(D1Gfx &gfx, QString filePath, const OpenAsParam &params)
 {
-    // Opening CEL file with a QBuffer to load it in RAM
+    // Opening CEL file with a memory mapping
     if (!QFile::exists(filePath))
         return false;
 
-    QFile file = QFile(filePath);
-
-    if (!file.open(QIODevice::ReadOnly))
-        return false;
-
-    QByteArray fileData = file.readAll();
-    QBuffer fileBuffer(&fileData);
-
-    if (!fileBuffer.open(QIODevice::ReadOnly))
+    std::unique_ptr<D1FileData> file = std::make_unique<D1FileData>();
+    if (!file->open(filePath))
         return false;
 
     // Read CEL binary data
-    QDataStream in(&fileBuffer);
-    in.setByteOrder(QDataStream::LittleEndian);
+    const D1DataView in = file->view();
 
     // CEL HEADER CHECKS
 
     // Read first DWORD
-    quint32 firstDword;
-    in >> firstDword;
+    quint32 firstDword = in.le32(0);
 
     // Trying to find file size in CEL header
-    if (fileBuffer.size() < (4 + firstDword * 4 + 4))
+    if (in.size() < (4 + firstDword * 4 + 4))
         return false;
 
-    fileBuffer.seek(firstDword * 4 + 4);
-    quint32 fileSizeDword;
-    in >> fileSizeDword;
+    quint32 fileSizeDword = in.le32(firstDword * 4 + 4);
 
     QList<QPair<quint32, quint32>> frameOffsets;
-    if (fileBuffer.size() == fileSizeDword) {
+    if (in.size() == fileSizeDword) {
         // Going through all frames of the CEL
         gfx.groupFrameIndices.clear();
         gfx.groupFrameIndices.append(qMakePair(0, firstDword - 1));
         for (unsigned int i = 1; i <= firstDword; i++) {
-            fileBuffer.seek(i * 4);
-            quint32 celFrameStartOffset;
-            in >> celFrameStartOffset;
-            quint32 celFrameEndOffset;
-            in >> celFrameEndOffset;
+            quint32 celFrameStartOffset = in.le32(i * 4);
+            quint32 celFrameEndOffset = in.le32(i * 4 + 4);
 
             frameOffsets.append(qMakePair(celFrameStartOffset, celFrameEndOffset));
         }
     } else {
         // Read offset of the last CEL of the CEL compilation
-        fileBuffer.seek(firstDword - 4);
-        quint32 lastCelOffset;
-        in >> lastCelOffset;
+        quint32 lastCelOffset = in.le32(firstDword - 4);
 
         // Go to last CEL of the CEL compilation
-        if (fileBuffer.size() < (lastCelOffset + 8))
+        if (in.size() < (lastCelOffset + 8))
             return false;
 
-        fileBuffer.seek(lastCelOffset);
-
         // Read last CEL header
-        quint32 lastCelFrameCount;
-        in >> lastCelFrameCount;
+        quint32 lastCelFrameCount = in.le32(lastCelOffset);
 
         // Read the last CEL size
-        if (fileBuffer.size() < (lastCelOffset + 4 + lastCelFrameCount * 4 + 4))
+        if (in.size() < (lastCelOffset + 4 + lastCelFrameCount * 4 + 4))
             return false;
 
-        fileBuffer.seek(lastCelOffset + 4 + lastCelFrameCount * 4);
-        quint32 lastCelSize;
-        in >> lastCelSize;
+        quint32 lastCelSize = in.le32(lastCelOffset + 4 + lastCelFrameCount * 4);
 
         // If the last CEL size plus the last CEL offset is equal to
         // the file size then it's a CEL compilation
-        if (fileBuffer.size() != (lastCelOffset + lastCelSize)) {
+        if (in.size() != (lastCelOffset + lastCelSize)) {
             return false;
         }
 
         // Going through all CELs
         gfx.groupFrameIndices.clear();
         for (unsigned int i = 0; i * 4 < firstDword; i++) {
-            fileBuffer.seek(i * 4);
-            quint32 celOffset;
-            in >> celOffset;
-
-            fileBuffer.seek(celOffset);
-            quint32 celFrameCount;
-            in >> celFrameCount;
+            quint32 celOffset = in.le32(i * 4);
+            quint32 celFrameCount = in.le32(celOffset);
 
             gfx.groupFrameIndices.append(
                 qMakePair(frameOffsets.size(),
@@ -104,12 +83,8 @@ bool D1Cel::load(D1Gfx &gfx, QString filePath, const OpenAsParam &params)
 
             // Going through all frames of the CEL
             for (unsigned int j = 1; j <= celFrameCount; j++) {
-                quint32 celFrameStartOffset = 0;
-                quint32 celFrameEndOffset = 0;
-
-                fileBuffer.seek(celOffset + j * 4);
-                in >> celFrameStartOffset;
-                in >> celFrameEndOffset;
+                quint32 celFrameStartOffset = in.le32(celOffset + j * 4);
+                quint32 celFrameEndOffset = in.le32(celOffset + j * 4 + 4);
 
                 frameOffsets.append(
                     qMakePair(celOffset + celFrameStartOffset,
@@ -123,33 +98,48 @@ bool D1Cel::load(D1Gfx &gfx, QString filePath, const OpenAsParam &params)
     // BUILDING {CEL FRAMES}
 
     if (params.clipped == OPEN_CLIPPED_TYPE::Auto) {
-        fileBuffer.seek(frameOffsets[0].first);
-        QDataStream header(fileBuffer.read(2));
-        header.setByteOrder(QDataStream::LittleEndian);
-        quint16 offset;
-        header >> offset;
+        quint16 offset = in.le16(frameOffsets[0].first);
         gfx.setHasHeader(offset == 0x0A);
     } else {
         gfx.setHasHeader(params.clipped == OPEN_CLIPPED_TYPE::Yes);
     }
 
-    gfx.frames.clear();
-    for (const auto &offset : frameOffsets) {
-        fileBuffer.seek(offset.first);
-        QByteArray celFrameRawData = fileBuffer.read(offset.second - offset.first);
-
-        D1GfxFrame frame;
-        if (!D1CelFrame::load(frame, celFrameRawData, params)) {
-            // TODO: log + add placeholder?
-            continue;
+    // The frames of a headerless CEL usually share the same width:
+    // infer it from the first few frames, the other frames only have to verify it
+    quint16 fileWidth = 0;
+    if (params.celWidth == 0 && !gfx.hasHeader()) {
+        const int numSamples = std::min((int)frameOffsets.size(), CEL_WIDTH_SAMPLE_FRAMES);
+        for (int i = 0; i < numSamples; i++) {
+            const auto &offset = frameOffsets[i];
+            quint16 width = D1CelFrame::computeWidthFromData(in.mid(offset.first, (qint64)offset.second - offset.first));
+            if (width == 0 || (fileWidth != 0 && width != fileWidth)) {
+                fileWidth = 0;
+                break;
+            }
+            fileWidth = width;
         }
-        gfx.frames.append(frame);
     }
 
+    // the frames are decoded on demand directly from the mapped file
+    gfx.clearFrames();
+    for (const auto &offset : frameOffsets) {
+        gfx.appendEncodedFrame(offset.first, offset.second > offset.first ? offset.second - offset.first : 0);
+    }
+    gfx.encodedFile = std::move(file);
+    gfx.frameDecoder = [params, fileWidth](D1GfxFrame &frame, const D1DataView &rawData) {
+        return D1CelFrame::load(frame, rawData, params, fileWidth);
+    };
+
     gfx.gfxFilePath = filePath;
     return true;
 }
 
+static int maxFrameSize(D1GfxFrame *frame, int subHeaderSize, bool writeHeader)
+{
+    // worst case: a command byte for every pixel
+    return (writeHeader ? subHeaderSize : 0) + frame->getHeight() * (2 * frame->getWidth());
+}
+
 static quint8 *writeFrameData(D1GfxFrame *frame, quint8 *pBuf, int subHeaderSize, bool writeHeader)
 {
     // add optional {CEL FRAME HEADER}
@@ -169,16 +159,17 @@ static quint8 *writeFrameData(D1GfxFrame *frame, quint8 *pBuf, int subHeaderSize
         if (writeHeader && (i % CEL_BLOCK_HEIGHT) == 1 /*&& (i / CEL_BLOCK_HEIGHT) * 2 < SUB_HEADER_SIZE*/) {
             *(quint16 *)(&pHeader[(i / CEL_BLOCK_HEIGHT) * 2]) = SwapLE16(pHead - pHeader); // pHead - buf - SUB_HEADER_SIZE;
         }
+        const int y = frame->getHeight() - i;
+        const quint8 *indexRow = frame->getIndexRow(y);
         for (int j = 0; j < frame->getWidth(); j++) {
-            D1GfxPixel pixel = frame->getPixel(j, frame->getHeight() - i);
-            if (!pixel.isTransparent()) {
+            if (!frame->isTransparent(j, y)) {
                 // add opaque pixel
                 if (alpha || *pHead > 126) {
                     pHead = pBuf;
                     pBuf++;
                 }
                 ++*pHead;
-                *pBuf = pixel.getPaletteIndex();
+                *pBuf = indexRow[j];
                 pBuf++;
                 alpha = false;
             } else {
@@ -195,7 +186,7 @@ static quint8 *writeFrameData(D1GfxFrame *frame, quint8 *pBuf, int subHeaderSize
     return pBuf;
 }
 
-bool D1Cel::writeFileData(D1Gfx &gfx, QFile &outFile)
+bool D1Cel::writeFileData(D1Gfx &gfx, D1FileWriter &writer)
 {
     bool writeHeader = gfx.hasHeader();
     const int numFrames = gfx.frames.count();
@@ -205,121 +196,107 @@ bool D1Cel::writeFileData(D1Gfx &gfx, QFile &outFile)
     // calculate sub header size
     int subHeaderSize = SUB_HEADER_SIZE;
     for (int n = 0; n < numFrames; n++) {
-        D1GfxFrame *frame = gfx.getFrame(n);
+        // the size of an evicted frame is known without decoding it again
         if (writeHeader) {
-            int hs = (frame->getHeight() - 1) / CEL_BLOCK_HEIGHT;
+            int hs = (gfx.getFrameHeight(n) - 1) / CEL_BLOCK_HEIGHT;
             hs = (hs + 1) * sizeof(quint16);
             subHeaderSize = std::max(subHeaderSize, hs);
         }
     }
-    // estimate data size
-    int maxSize = HEADER_SIZE;
-    for (int n = 0; n < numFrames; n++) {
-        D1GfxFrame *frame = gfx.getFrame(n);
-        if (writeHeader) {
-            maxSize += subHeaderSize; // SUB_HEADER_SIZE
-        }
-        maxSize += frame->getHeight() * (2 * frame->getWidth());
-    }
 
-    QByteArray fileData;
-    fileData.append(maxSize, 0);
+    QByteArray headerData;
+    headerData.fill(0, HEADER_SIZE);
 
-    quint8 *buf = (quint8 *)fileData.data();
+    quint8 *buf = (quint8 *)headerData.data();
     *(quint32 *)&buf[0] = SwapLE32(numFrames);
     *(quint32 *)&buf[4] = SwapLE32(HEADER_SIZE);
-    quint8 *pBuf = &buf[HEADER_SIZE];
+    // the header is written after the frames, once the offsets are known
+    writer.reserve(HEADER_SIZE);
+    writer.advance(HEADER_SIZE);
     for (int n = 0; n < numFrames; n++) {
         D1GfxFrame *frame = gfx.getFrame(n);
-        pBuf = writeFrameData(frame, pBuf, subHeaderSize, writeHeader);
-        *(quint32 *)&buf[4 + 4 * (n + 1)] = SwapLE32(pBuf - buf);
+        quint8 *pBuf = writer.reserve(maxFrameSize(frame, subHeaderSize, writeHeader));
+        quint8 *pEnd = writeFrameData(frame, pBuf, subHeaderSize, writeHeader);
+        writer.advance(pEnd - pBuf);
+        *(quint32 *)&buf[4 + 4 * (n + 1)] = SwapLE32(writer.pos());
     }
-
-    // write to file
-    QDataStream out(&outFile);
-    out.writeRawData((char *)buf, pBuf - buf);
+    writer.writeAt(0, headerData);
 
     return true;
 }
 
-bool D1Cel::writeCompFileData(D1Gfx &gfx, QFile &outFile)
+bool D1Cel::writeCompFileData(D1Gfx &gfx, D1FileWriter &writer)
 {
     bool writeHeader = gfx.hasHeader();
     const int numFrames = gfx.frames.count();
 
-    // calculate header size
-    int headerSize = 0;
     int numGroups = gfx.getGroupCount();
-    for (int i = 0; i < numGroups; i++) {
-        QPair<quint16, quint16> gfi = gfx.getGroupFrameIndices(i);
-        int ni = gfi.second - gfi.first + 1;
-        headerSize += 4 + 4 * (ni + 1);
-    }
-
-    headerSize += sizeof(quint32) * numGroups;
 
     // calculate sub header size
     int subHeaderSize = SUB_HEADER_SIZE;
     for (int n = 0; n < numFrames; n++) {
-        D1GfxFrame *frame = gfx.getFrame(n);
+        // the size of an evicted frame is known without decoding it again
         if (writeHeader) {
-            int hs = (frame->getHeight() - 1) / CEL_BLOCK_HEIGHT;
+            int hs = (gfx.getFrameHeight(n) - 1) / CEL_BLOCK_HEIGHT;
             hs = (hs + 1) * sizeof(quint16);
             subHeaderSize = std::max(subHeaderSize, hs);
         }
     }
-    // estimate data size
-    int maxSize = headerSize;
-    for (int n = 0; n < numFrames; n++) {
-        D1GfxFrame *frame = gfx.getFrame(n);
-        if (writeHeader) {
-            maxSize += subHeaderSize; // SUB_HEADER_SIZE
-        }
-        maxSize += frame->getHeight() * (2 * frame->getWidth());
-    }
 
-    QByteArray fileData;
-    fileData.append(maxSize, 0);
+    QByteArray groupOffsets;
+    groupOffsets.fill(0, sizeof(quint32) * numGroups);
+    writer.reserve(groupOffsets.size());
+    writer.advance(groupOffsets.size());
 
-    quint8 *buf = (quint8 *)fileData.data();
-    quint8 *pBuf = &buf[sizeof(quint32) * numGroups];
     int idx = 0;
     for (int ii = 0; ii < numGroups; ii++) {
         QPair<quint16, quint16> gfi = gfx.getGroupFrameIndices(ii);
         int ni = gfi.second - gfi.first + 1;
-        *(quint32 *)&buf[ii * sizeof(quint32)] = SwapLE32(pBuf - buf);
+        const qint64 hdrOffset = writer.pos();
+        *(quint32 *)&groupOffsets.data()[ii * sizeof(quint32)] = SwapLE32(hdrOffset);
 
-        quint8 *hdr = pBuf;
+        QByteArray headerData;
+        headerData.fill(0, 4 + 4 * (ni + 1));
+        quint8 *hdr = (quint8 *)headerData.data();
         *(quint32 *)&hdr[0] = SwapLE32(ni);
         *(quint32 *)&hdr[4] = SwapLE32(4 + 4 * (ni + 1));
 
-        pBuf += 4 + 4 * (ni + 1);
+        writer.reserve(headerData.size());
+        writer.advance(headerData.size());
         for (int n = 0; n < ni; n++, idx++) {
             D1GfxFrame *frame = gfx.getFrame(idx); // TODO: what if the groups are not continuous?
-            pBuf = writeFrameData(frame, pBuf, subHeaderSize, writeHeader);
-            *(quint32 *)&hdr[4 + 4 * (n + 1)] = SwapLE32(pBuf - hdr);
+            quint8 *pBuf = writer.reserve(maxFrameSize(frame, subHeaderSize, writeHeader));
+            quint8 *pEnd = writeFrameData(frame, pBuf, subHeaderSize, writeHeader);
+            writer.advance(pEnd - pBuf);
+            *(quint32 *)&hdr[4 + 4 * (n + 1)] = SwapLE32(writer.pos() - hdrOffset);
         }
+        writer.writeAt(hdrOffset, headerData);
     }
-    // write to file
-    QDataStream out(&outFile);
-    out.writeRawData((char *)buf, pBuf - buf);
+    writer.writeAt(0, groupOffsets);
 
     return true;
 }
 
 bool D1Cel::save(D1Gfx &gfx, const QString &gfxPath)
 {
-    QFile outFile = QFile(gfxPath);
-    if (!outFile.open(QIODevice::WriteOnly | QFile::Truncate)) {
+    // the frames are encoded one by one, decoded on demand from the source file (within the limit of the decoded frames)
+    D1FileWriter writer;
+    if (!writer.open(gfxPath)) {
         QMessageBox::critical(nullptr, "Error", "Failed open file: " + gfxPath);
         return false;
     }
 
     bool success;
     if (gfx.getGroupCount() > 1) {
-        success = D1Cel::writeCompFileData(gfx, outFile);
+        success = D1Cel::writeCompFileData(gfx, writer);
     } else {
-        success = D1Cel::writeFileData(gfx, outFile);
+        success = D1Cel::writeFileData(gfx, writer);
+    }
+    if (success)
+        gfx.releaseEncodedFile(gfxPath);
+    if (success && !writer.commit()) {
+        QMessageBox::critical(nullptr, "Error", "Failed to write file: " + gfxPath);
+        success = false;
     }
 
     if (success) {
@@ -1,8 +1,8 @@
 #pragma once
 
-#include <QFile>
 #include <QString>
 
+#include "d1filewriter.h"
 #include "d1gfx.h"
 #include "dialogs/openasdialog.h"
 
@@ -12,6 +12,6 @@ public:
     static bool save(D1Gfx &gfx, const QString &gfxPath);
 
 private:
-    static bool writeFileData(D1Gfx &gfx, QFile &outFile);
-    static bool writeCompFileData(D1Gfx &gfx, QFile &outFile);
+    static bool writeFileData(D1Gfx &gfx, D1FileWriter &writer);
+    static bool writeCompFileData(D1Gfx &gfx, D1FileWriter &writer);
 };
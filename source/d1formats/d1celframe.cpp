@@ -1,22 +1,40 @@
 #include "d1celframe.h"
 
-D1CelPixelGroup::D1CelPixelGroup(bool t, quint16 c)
-    : transparent(t)
-    , pixelCount(c)
-{
-}
+namespace {
 
-bool D1CelPixelGroup::isTransparent() const
+// Call func(transparent, pixelCount) for each pixel group of the frame data
+// Consecutive 0x80 (transparent) and 0x7F (palette indices) commands are merged with the following one.
+template <typename F>
+void forEachPixelGroup(const D1DataView &rawFrameData, quint32 frameDataStartOffset, F func)
 {
-    return this->transparent;
-}
+    quint16 pixelCount = 0;
+    for (int o = frameDataStartOffset; o < rawFrameData.size(); o++) {
+        quint8 readByte = rawFrameData[o];
 
-quint16 D1CelPixelGroup::getPixelCount()
-{
-    return this->pixelCount;
+        // Transparent pixels group
+        if (readByte > 0x80) {
+            pixelCount += (256 - readByte);
+            func(true, pixelCount);
+            pixelCount = 0;
+        } else if (readByte == 0x80) {
+            pixelCount += 0x80;
+        }
+        // Palette indices pixel group
+        else if (readByte == 0x7F) {
+            pixelCount += 0x7F;
+            o += 0x7F;
+        } else {
+            pixelCount += readByte;
+            func(false, pixelCount);
+            pixelCount = 0;
+            o += readByte;
+        }
+    }
 }
 
-bool D1CelFrame::load(D1GfxFrame &frame, QByteArray rawData, const OpenAsParam &params)
+} // namespace
+
+bool D1CelFrame::load(D1GfxFrame &frame, const D1DataView &rawData, const OpenAsParam &params, quint16 fileWidth)
 {
     if (rawData.size() == 0)
         return false;
@@ -24,10 +42,7 @@ bool D1CelFrame::load(D1GfxFrame &frame, QByteArray rawData, const OpenAsParam &
     quint32 frameDataStartOffset = 0;
     quint16 width = 0;
     if (params.clipped != OPEN_CLIPPED_TYPE::No) {
-        QDataStream in(rawData);
-        in.setByteOrder(QDataStream::LittleEndian);
-        quint16 offset;
-        in >> offset;
+        quint16 offset = rawData.le16(0);
         if (offset == 0x0A || params.clipped == OPEN_CLIPPED_TYPE::Yes) {
             frameDataStartOffset += offset;
             // If header is present, try to compute frame width from frame header
@@ -37,7 +52,10 @@ bool D1CelFrame::load(D1GfxFrame &frame, QByteArray rawData, const OpenAsParam &
     frame.width = params.celWidth == 0 ? width : params.celWidth;
 
     // If width could not be calculated with frame header,
+    // use the width of the file if it fits the frame data or
     // attempt to calculate it from the frame data (by identifying pixel groups line wraps)
+    if (frame.width == 0 && fileWidth != 0 && D1CelFrame::verifyWidth(rawData, frameDataStartOffset, fileWidth))
+        frame.width = fileWidth;
     if (frame.width == 0)
         frame.width = D1CelFrame::computeWidthFromData(rawData);
 
@@ -45,50 +63,59 @@ bool D1CelFrame::load(D1GfxFrame &frame, QByteArray rawData, const OpenAsParam &
     if (frame.width == 0)
         return false;
 
-    // READ {CEL FRAME DATA}
-    QList<D1GfxPixel> pixelLine;
+    // Count the pixels to allocate the frame in one go (incomplete pixel-lines are dropped)
+    int pixelCount = 0;
     for (int o = frameDataStartOffset; o < rawData.size(); o++) {
         quint8 readByte = rawData[o];
+        if (readByte > 0x7F) {
+            pixelCount += 256 - readByte;
+        } else {
+            pixelCount += readByte;
+            o += readByte;
+        }
+    }
+    frame.resize(frame.width, pixelCount / frame.width);
+
+    // READ {CEL FRAME DATA}
+    // pixel-lines are stored bottom-up, transparent pixels are already set by resize
+    int x = 0;
+    int y = frame.height - 1;
+    for (int o = frameDataStartOffset; o < rawData.size() && y >= 0; o++) {
+        quint8 readByte = rawData[o];
 
         // Transparent pixels group
         if (readByte > 0x7F) {
             // A pixel line can't exceed the image width
-            if ((pixelLine.size() + (256 - readByte)) > frame.width)
+            if ((x + (256 - readByte)) > frame.width)
                 return false;
 
-            for (int i = 0; i < (256 - readByte); i++)
-                pixelLine.append(D1GfxPixel::transparentPixel());
+            x += 256 - readByte;
         } else {
             // Palette indices group
             // A pixel line can't exceed the image width
-            if ((pixelLine.size() + readByte) > frame.width)
+            if ((x + readByte) > frame.width || o + readByte >= rawData.size())
                 return false;
 
             for (int i = 0; i < readByte; i++) {
                 o++;
-                pixelLine.append(D1GfxPixel::colorPixel(rawData[o]));
+                frame.setPixel(x, y, rawData[o]);
+                x++;
             }
         }
 
-        if (pixelLine.size() == frame.width) {
-            frame.pixels.insert(0, pixelLine);
-            pixelLine.clear();
+        if (x == frame.width) {
+            x = 0;
+            y--;
         }
     }
 
-    frame.height = frame.pixels.size();
-
     return true;
 }
 
-quint16 D1CelFrame::computeWidthFromHeader(QByteArray &rawFrameData)
+quint16 D1CelFrame::computeWidthFromHeader(const D1DataView &rawFrameData)
 {
     // Reading the frame header
-    QDataStream in(rawFrameData);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    quint16 celFrameHeaderSize;
-    in >> celFrameHeaderSize;
+    quint16 celFrameHeaderSize = rawFrameData.le16(0);
 
     if (celFrameHeaderSize & 1)
         return 0; // invalid header
@@ -97,8 +124,7 @@ quint16 D1CelFrame::computeWidthFromHeader(QByteArray &rawFrameData)
     quint16 celFrameWidth = 0;
     quint16 lastFrameOffset = celFrameHeaderSize;
     for (int i = 0; i < (celFrameHeaderSize / 2) - 1; i++) {
-        quint16 nextFrameOffset;
-        in >> nextFrameOffset;
+        quint16 nextFrameOffset = rawFrameData.le16(2 + i * 2);
         if (nextFrameOffset == 0)
             break;
 
@@ -127,101 +153,133 @@ quint16 D1CelFrame::computeWidthFromHeader(QByteArray &rawFrameData)
     return celFrameWidth;
 }
 
-quint16 D1CelFrame::computeWidthFromData(QByteArray &rawFrameData)
+quint16 D1CelFrame::computeWidthFromData(const D1DataView &rawFrameData)
 {
-    quint16 biggestGroupPixelCount = 0;
-    quint16 pixelCount = 0;
-    quint16 width = 0;
-    QList<D1CelPixelGroup *> pixelGroups;
-
     // Checking the presence of the {CEL FRAME HEADER}
     quint32 frameDataStartOffset = 0;
-    if ((quint8)rawFrameData[0] == 0x0A && (quint8)rawFrameData[1] == 0x00)
+    if (rawFrameData[0] == 0x0A && rawFrameData[1] == 0x00)
         frameDataStartOffset = 0x0A;
 
-    // Going through the frame data to find pixel groups
+    // Going through the pixel groups to find pixel-lines wraps
+    quint16 biggestGroupPixelCount = 0;
     quint32 globalPixelCount = 0;
-    for (int o = frameDataStartOffset; o < rawFrameData.size(); o++) {
-        quint8 readByte = rawFrameData[o];
-
-        // Transparent pixels group
-        if (readByte > 0x80) {
-            pixelCount += (256 - readByte);
-            pixelGroups.append(new D1CelPixelGroup(true, pixelCount));
-            globalPixelCount += pixelCount;
-            if (pixelCount > biggestGroupPixelCount)
-                biggestGroupPixelCount = pixelCount;
-            pixelCount = 0;
-        } else if (readByte == 0x80) {
-            pixelCount += 0x80;
-        }
-        // Palette indices pixel group
-        else if (readByte == 0x7F) {
-            pixelCount += 0x7F;
-            o += 0x7F;
-        } else {
-            pixelCount += readByte;
-            pixelGroups.append(new D1CelPixelGroup(false, pixelCount));
-            globalPixelCount += pixelCount;
-            if (pixelCount > biggestGroupPixelCount)
-                biggestGroupPixelCount = pixelCount;
-            pixelCount = 0;
-            o += readByte;
-        }
-    }
-
-    // Going through pixel groups to find pixel-lines wraps
-    pixelCount = 0;
-    for (int i = 1; i < pixelGroups.size(); i++) {
-        pixelCount += pixelGroups[i - 1]->getPixelCount();
-
-        if (pixelGroups[i - 1]->isTransparent() == pixelGroups[i]->isTransparent()) {
-            // If width == 0 then it's the first pixel-line wrap and width needs to be set
-            // If pixelCount is less than width then the width has to be set to the new value
-            if (width == 0 || pixelCount < width)
-                width = pixelCount;
-
-            // If the pixelCount of the last group is less than the current pixel group
-            // then width is equal to this last pixel group's pixel count.
-            // Mostly useful for small frames like the "J" frame in smaltext.cel
-            if (i == pixelGroups.size() - 1 && pixelGroups[i]->getPixelCount() < pixelCount)
-                width = pixelGroups[i]->getPixelCount();
-
-            pixelCount = 0;
-        }
-
-        // If last pixel group is being processed and width is still unknown
-        // then set the width to the pixelCount of the last two pixel groups
-        if (i == pixelGroups.size() - 1 && width == 0) {
-            width = pixelGroups[i - 1]->getPixelCount() + pixelGroups[i]->getPixelCount();
+    int numGroups = 0;
+    bool prevTransparent = false;
+    quint16 prevPixelCount = 0;
+    quint16 prevPrevPixelCount = 0;
+    quint16 pixelCount = 0;
+    quint16 width = 0;
+    // state of the last pair of groups
+    bool lastWrap = false;
+    quint16 lastWrapPixelCount = 0;
+    forEachPixelGroup(rawFrameData, frameDataStartOffset, [&](bool transparent, quint16 groupPixelCount) {
+        globalPixelCount += groupPixelCount;
+        if (groupPixelCount > biggestGroupPixelCount)
+            biggestGroupPixelCount = groupPixelCount;
+
+        if (numGroups != 0) {
+            pixelCount += prevPixelCount;
+            lastWrap = prevTransparent == transparent;
+            if (lastWrap) {
+                // If width == 0 then it's the first pixel-line wrap and width needs to be set
+                // If pixelCount is less than width then the width has to be set to the new value
+                if (width == 0 || pixelCount < width)
+                    width = pixelCount;
+
+                lastWrapPixelCount = pixelCount;
+                pixelCount = 0;
+            }
         }
+        numGroups++;
+        prevTransparent = transparent;
+        prevPrevPixelCount = prevPixelCount;
+        prevPixelCount = groupPixelCount;
+    });
+
+    if (numGroups >= 2) {
+        // If the pixelCount of the last group is less than the last pixel-line
+        // then width is equal to this last pixel group's pixel count.
+        // Mostly useful for small frames like the "J" frame in smaltext.cel
+        if (lastWrap && prevPixelCount < lastWrapPixelCount)
+            width = prevPixelCount;
+
+        // If width is still unknown then set the width to the pixelCount of the last two pixel groups
+        if (width == 0)
+            width = prevPrevPixelCount + prevPixelCount;
     }
 
     // If width wasnt found return 0
-    if (width == 0) {
-        qDeleteAll(pixelGroups);
+    if (width == 0)
         return 0;
-    }
 
     // If width is consistent
-    if (globalPixelCount % width == 0) {
-        qDeleteAll(pixelGroups);
+    if (globalPixelCount % width == 0)
         return width;
-    }
 
-    // Try to find  relevant width by adding pixel groups' pixel counts iteratively
+    // Try to find  relevant width by adding pixel groups' pixel counts iteratively (rare, requires a second pass)
+    quint16 result = 0;
     pixelCount = 0;
-    for (int i = 0; i < pixelGroups.size(); i++) {
-        pixelCount += pixelGroups[i]->getPixelCount();
-        if (pixelCount > 1
+    forEachPixelGroup(rawFrameData, frameDataStartOffset, [&](bool, quint16 groupPixelCount) {
+        pixelCount += groupPixelCount;
+        if (result == 0
+            && pixelCount > 1
             && globalPixelCount % pixelCount == 0
             && pixelCount >= biggestGroupPixelCount) {
-            qDeleteAll(pixelGroups);
-            return pixelCount;
+            result = pixelCount;
         }
-    }
+    });
 
-    qDeleteAll(pixelGroups);
     // If still no width found return 0
-    return 0;
+    return result;
+}
+
+// Check if the frame data can be decoded with the given width (every pixel-line is complete)
+// and the pixel-line wraps used by computeWidthFromData do not point to a different width
+bool D1CelFrame::verifyWidth(const D1DataView &rawFrameData, quint32 frameDataStartOffset, quint16 width)
+{
+    int x = 0;
+    int pixelCount = 0;
+    int groupStart = 0;
+    int lastWrap = 0;
+    int minWrapDistance = 0;
+    int numGroups = 0;
+    bool prevTransparent = false;
+    for (int o = frameDataStartOffset; o < rawFrameData.size(); o++) {
+        quint8 readByte = rawFrameData[o];
+        bool transparent = readByte > 0x7F;
+        int groupPixelCount;
+        if (transparent) {
+            groupPixelCount = 256 - readByte;
+        } else {
+            if (o + readByte >= rawFrameData.size())
+                return false;
+            groupPixelCount = readByte;
+            o += readByte;
+        }
+        x += groupPixelCount;
+        pixelCount += groupPixelCount;
+        // A pixel line can't exceed the image width
+        if (x > width)
+            return false;
+        if (x == width)
+            x = 0;
+
+        // 0x80 and 0x7F commands are merged with the following one
+        if (readByte == 0x80 || readByte == 0x7F)
+            continue;
+        if (numGroups != 0 && transparent == prevTransparent) {
+            // consecutive groups of the same type are split by a pixel-line wrap
+            if (groupStart % width != 0)
+                return false;
+            int distance = groupStart - lastWrap;
+            if (minWrapDistance == 0 || distance < minWrapDistance)
+                minWrapDistance = distance;
+            lastWrap = groupStart;
+        }
+        numGroups++;
+        prevTransparent = transparent;
+        groupStart = pixelCount;
+    }
+    // the closest wraps have to be one pixel-line apart
+    return x == 0 && (minWrapDistance == 0 || minWrapDistance == width);
 }
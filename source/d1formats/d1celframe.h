@@ -1,29 +1,18 @@
 #pragma once
 
-#include <QByteArray>
-
+#include "d1dataview.h"
 #include "d1gfx.h"
 #include "dialogs/openasdialog.h"
 
-// Class used only for CEL frame width calculation
-class D1CelPixelGroup {
-public:
-    D1CelPixelGroup() = default;
-    D1CelPixelGroup(bool, quint16);
-
-    bool isTransparent() const;
-    quint16 getPixelCount();
-
-private:
-    bool transparent = false;
-    quint16 pixelCount = 0;
-};
-
 class D1CelFrame {
+    friend class D1Cel;
+
 public:
-    static bool load(D1GfxFrame &frame, QByteArray rawData, const OpenAsParam &params);
+    // fileWidth: the width shared by the frames of the file (0 if unknown), used if it fits the frame data
+    static bool load(D1GfxFrame &frame, const D1DataView &rawData, const OpenAsParam &params, quint16 fileWidth = 0);
 
 private:
-    static quint16 computeWidthFromHeader(QByteArray &);
-    static quint16 computeWidthFromData(QByteArray &);
+    static quint16 computeWidthFromHeader(const D1DataView &);
+    static quint16 computeWidthFromData(const D1DataView &);
+    static bool verifyWidth(const D1DataView &, quint32 frameDataStartOffset, quint16 width);
 };
@@ -4,6 +4,7 @@
 #include <QByteArray>
 #include <QDataStream>
 #include <QDebug>
+#include <QFile>
 #include <QMessageBox>
 
 #include "d1celtilesetframe.h"
@@ -124,7 +125,7 @@ bool D1CelTileset::load(D1Gfx &gfx, std::map<unsigned, D1CEL_FRAME_TYPE> &celFra
     }
 
     // BUILDING {CEL FRAMES}
-    gfx.frames.clear();
+    gfx.clearFrames();
     for (int i = 0; i < frameOffsets.count(); i++) {
         const auto &offset = frameOffsets[i];
         fileBuffer.seek(offset.first);
@@ -148,48 +149,55 @@ bool D1CelTileset::load(D1Gfx &gfx, std::map<unsigned, D1CEL_FRAME_TYPE> &celFra
     return true;
 }
 
-bool D1CelTileset::writeFileData(D1Gfx &gfx, QFile &outFile)
+bool D1CelTileset::writeFileData(D1Gfx &gfx, D1FileWriter &writer)
 {
     const int numFrames = gfx.getFrameCount();
 
     // calculate header size
     int headerSize = 4 + numFrames * 4 + 4;
 
-    // estimate data size
-    int maxSize = headerSize;
-    maxSize += MICRO_WIDTH * MICRO_HEIGHT * numFrames;
+    QByteArray headerData;
+    headerData.fill(0, headerSize);
 
-    QByteArray fileData;
-    fileData.append(maxSize, 0);
-
-    quint8 *buf = (quint8 *)fileData.data();
+    quint8 *buf = (quint8 *)headerData.data();
     *(quint32 *)&buf[0] = SwapLE32(numFrames);
 
-    quint8 *pBuf = &buf[headerSize];
+    // the header is written after the frames, once the offsets are known
+    writer.reserve(headerSize);
+    writer.advance(headerSize);
     for (int ii = 0; ii < numFrames; ii++) {
-        *(quint32 *)&buf[(ii + 1) * sizeof(quint32)] = SwapLE32(pBuf - buf);
+        *(quint32 *)&buf[(ii + 1) * sizeof(quint32)] = SwapLE32(writer.pos());
 
-        pBuf = D1CelTilesetFrame::writeFrameData(*gfx.getFrame(ii), pBuf);
+        // worst case: a command byte for every pixel
+        quint8 *pBuf = writer.reserve(2 * MICRO_WIDTH * MICRO_HEIGHT);
+        quint8 *pEnd = D1CelTilesetFrame::writeFrameData(*gfx.getFrame(ii), pBuf);
+        if (pEnd == nullptr)
+            return false;
+        writer.advance(pEnd - pBuf);
     }
 
-    *(quint32 *)&buf[(numFrames + 1) * sizeof(quint32)] = SwapLE32(pBuf - buf);
-
-    // write to file
-    QDataStream out(&outFile);
-    out.writeRawData((char *)buf, pBuf - buf);
+    *(quint32 *)&buf[(numFrames + 1) * sizeof(quint32)] = SwapLE32(writer.pos());
+    writer.writeAt(0, headerData);
 
     return true;
 }
 
 bool D1CelTileset::save(D1Gfx &gfx, const QString &gfxPath)
 {
-    QFile outFile = QFile(gfxPath);
-    if (!outFile.open(QIODevice::WriteOnly | QFile::Truncate)) {
+    D1FileWriter writer;
+    if (!writer.open(gfxPath)) {
         QMessageBox::critical(nullptr, "Error", "Failed open file: " + gfxPath);
         return false;
     }
 
-    bool success = D1CelTileset::writeFileData(gfx, outFile);
+    bool success = D1CelTileset::writeFileData(gfx, writer);
+    if (!success) {
+        // keep the original file
+        writer.cancel();
+    } else if (!writer.commit()) {
+        QMessageBox::critical(nullptr, "Error", "Failed to write file: " + gfxPath);
+        success = false;
+    }
 
     if (success) {
         gfx.modified = false;
@@ -2,10 +2,10 @@
 
 #include <map>
 
-#include <QFile>
 #include <QString>
 
 #include "d1celtilesetframe.h"
+#include "d1filewriter.h"
 #include "d1gfx.h"
 #include "dialogs/openasdialog.h"
 
@@ -15,5 +15,5 @@ public:
     static bool save(D1Gfx &gfx, const QString &gfxPath);
 
 private:
-    static bool writeFileData(D1Gfx &gfx, QFile &outFile);
+    static bool writeFileData(D1Gfx &gfx, D1FileWriter &writer);
 };
@@ -11,8 +11,7 @@ bool D1CelTilesetFrame::load(D1GfxFrame &frame, D1CEL_FRAME_TYPE type, QByteArra
     if (rawData.size() == 0)
         return false;
 
-    frame.width = MICRO_WIDTH;
-    frame.height = MICRO_HEIGHT;
+    frame.resize(MICRO_WIDTH, MICRO_HEIGHT);
     frame.frameType = type;
     switch (type) {
     case D1CEL_FRAME_TYPE::Square:
@@ -41,70 +40,53 @@ bool D1CelTilesetFrame::load(D1GfxFrame &frame, D1CEL_FRAME_TYPE type, QByteArra
 void D1CelTilesetFrame::LoadSquare(D1GfxFrame &frame, QByteArray &rawData)
 {
     int offset = 0;
-    for (int i = 0; i < frame.height; i++) {
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < frame.width; j++) {
-            pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
+    for (int y = frame.height - 1; y >= 0; y--) {
+        for (int x = 0; x < frame.width; x++) {
+            frame.setPixel(x, y, rawData[offset++]);
         }
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
 void D1CelTilesetFrame::LoadTransparentSquare(D1GfxFrame &frame, QByteArray &rawData)
 {
     int offset = 0;
-    for (int i = 0; i < frame.height; i++) {
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < frame.width;) {
+    for (int y = frame.height - 1; y >= 0; y--) {
+        for (int x = 0; x < frame.width;) {
             qint8 readByte = rawData[offset++];
             if (readByte < 0) {
-                readByte = -readByte;
                 // transparent pixels
-                D1GfxPixel pixel = D1GfxPixel::transparentPixel();
-                for (int j = 0; j < readByte; j++) {
-                    pixelLine.append(pixel);
-                }
+                x -= readByte;
             } else {
                 // color pixels
-                for (int j = 0; j < readByte; j++) {
-                    pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
+                for (int j = 0; j < readByte && x < frame.width; j++, x++) {
+                    frame.setPixel(x, y, rawData[offset++]);
                 }
             }
-            j += readByte;
         }
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
 void D1CelTilesetFrame::LoadBottomLeftTriangle(D1GfxFrame &frame, QByteArray &rawData)
 {
     int offset = 0;
-    for (int i = 1; i <= frame.height / 2; i++) {
+    int y = frame.height - 1;
+    for (int i = 1; i <= frame.height / 2; i++, y--) {
         offset += 2 * (i % 2);
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < frame.width - 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::transparentPixel());
-        }
-        for (int j = 0; j < 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
+        for (int x = frame.width - 2 * i; x < frame.width; x++) {
+            frame.setPixel(x, y, rawData[offset++]);
         }
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
 void D1CelTilesetFrame::LoadBottomRightTriangle(D1GfxFrame &frame, QByteArray &rawData)
 {
     int offset = 0;
-    for (int i = 1; i <= frame.height / 2; i++) {
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
-        }
-        for (int j = 0; j < frame.width - 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::transparentPixel());
+    int y = frame.height - 1;
+    for (int i = 1; i <= frame.height / 2; i++, y--) {
+        for (int x = 0; x < 2 * i; x++) {
+            frame.setPixel(x, y, rawData[offset++]);
         }
         offset += 2 * (i % 2);
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
@@ -112,16 +94,12 @@ void D1CelTilesetFrame::LoadLeftTriangle(D1GfxFrame &frame, QByteArray &rawData)
 {
     D1CelTilesetFrame::LoadBottomLeftTriangle(frame, rawData);
     int offset = 288;
-    for (int i = 1; i <= frame.height / 2; i++) {
+    int y = frame.height / 2 - 1;
+    for (int i = 1; i <= frame.height / 2; i++, y--) {
         offset += 2 * (i % 2);
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::transparentPixel());
-        }
-        for (int j = 0; j < frame.width - 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
+        for (int x = 2 * i; x < frame.width; x++) {
+            frame.setPixel(x, y, rawData[offset++]);
         }
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
@@ -129,28 +107,22 @@ void D1CelTilesetFrame::LoadRightTriangle(D1GfxFrame &frame, QByteArray &rawData
 {
     D1CelTilesetFrame::LoadBottomRightTriangle(frame, rawData);
     int offset = 288;
-    for (int i = 1; i <= frame.height / 2; i++) {
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < frame.width - 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
-        }
-        for (int j = 0; j < 2 * i; j++) {
-            pixelLine.append(D1GfxPixel::transparentPixel());
+    int y = frame.height / 2 - 1;
+    for (int i = 1; i <= frame.height / 2; i++, y--) {
+        for (int x = 0; x < frame.width - 2 * i; x++) {
+            frame.setPixel(x, y, rawData[offset++]);
         }
         offset += 2 * (i % 2);
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
 void D1CelTilesetFrame::LoadTopHalfSquare(D1GfxFrame &frame, QByteArray &rawData)
 {
     int offset = 288;
-    for (int i = 1; i <= frame.height / 2; i++) {
-        QList<D1GfxPixel> pixelLine;
-        for (int j = 0; j < frame.width; j++) {
-            pixelLine.append(D1GfxPixel::colorPixel(rawData[offset++]));
+    for (int y = frame.height / 2 - 1; y >= 0; y--) {
+        for (int x = 0; x < frame.width; x++) {
+            frame.setPixel(x, y, rawData[offset++]);
         }
-        frame.pixels.insert(0, pixelLine);
     }
 }
 
@@ -166,8 +138,14 @@ void D1CelTilesetFrame::LoadRightTrapezoid(D1GfxFrame &frame, QByteArray &rawDat
     D1CelTilesetFrame::LoadTopHalfSquare(frame, rawData);
 }
 
+// returns nullptr if the frame does not match its type
 quint8 *D1CelTilesetFrame::writeFrameData(D1GfxFrame &frame, quint8 *pDst)
 {
+    if (frame.width != MICRO_WIDTH || frame.height != MICRO_HEIGHT) {
+        QMessageBox::critical(nullptr, "Error", "Invalid frame size.");
+        return nullptr;
+    }
+
     switch (frame.frameType) {
     case D1CEL_FRAME_TYPE::LeftTriangle:
         pDst = D1CelTilesetFrame::WriteLeftTriangle(frame, pDst);
@@ -190,7 +168,7 @@ quint8 *D1CelTilesetFrame::writeFrameData(D1GfxFrame &frame, quint8 *pDst)
     default:
         // case D1CEL_FRAME_TYPE::Unknown:
         QMessageBox::critical(nullptr, "Error", "Unknown frame type.");
-        break;
+        return nullptr;
     }
     return pDst;
 }
@@ -203,12 +181,11 @@ quint8 *D1CelTilesetFrame::WriteSquare(D1GfxFrame &frame, quint8 *pDst)
     // add opaque pixels
     for (y = MICRO_HEIGHT - 1; y >= 0; y--) {
         for (x = 0; x < MICRO_WIDTH; ++x) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Square frame I.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
     }
@@ -225,8 +202,7 @@ quint8 *D1CelTilesetFrame::WriteTransparentSquare(D1GfxFrame &frame, quint8 *pDs
     for (y = MICRO_HEIGHT - 1; y >= 0; y--) {
         bool alpha = false;
         for (x = 0; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 // add transparent pixel
                 if ((char)(*pHead) > 0) {
                     pHead = pDst;
@@ -241,7 +217,7 @@ quint8 *D1CelTilesetFrame::WriteTransparentSquare(D1GfxFrame &frame, quint8 *pDs
                     pHead = pDst;
                     pDst++;
                 }
-                *pDst = pixel.getPaletteIndex();
+                *pDst = frame.getPaletteIndex(x, y);
                 pDst++;
                 ++*pHead;
                 hasColor = true;
@@ -267,21 +243,19 @@ quint8 *D1CelTilesetFrame::WriteLeftTriangle(D1GfxFrame &frame, quint8 *pDst)
     for (i = MICRO_HEIGHT - 2; i >= 0; i -= 2, y--) {
         // check transparent pixels
         for (x = 0; x < i; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (!pixel.isTransparent()) {
+            if (!frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid non-transparent pixel in a Left Triangle frame I.");
-                return pDst;
+                return nullptr;
             }
         }
         pDst += i & 2;
         // add opaque pixels
         for (x = i; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Left Triangle frame I.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
     }
@@ -289,21 +263,19 @@ quint8 *D1CelTilesetFrame::WriteLeftTriangle(D1GfxFrame &frame, quint8 *pDst)
     for (i = 2; i != MICRO_HEIGHT; i += 2, y--) {
         // check transparent pixels
         for (x = 0; x < i; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (!pixel.isTransparent()) {
+            if (!frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid non-transparent pixel in a Left Triangle frame II.");
-                return pDst;
+                return nullptr;
             }
         }
         pDst += i & 2;
         // add opaque pixels
         for (x = i; x < MICRO_WIDTH; ++x) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Left Triangle frame II.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
     }
@@ -320,21 +292,19 @@ quint8 *D1CelTilesetFrame::WriteRightTriangle(D1GfxFrame &frame, quint8 *pDst)
     for (i = MICRO_HEIGHT - 2; i >= 0; i -= 2, y--) {
         // add opaque pixels
         for (x = 0; x < (MICRO_WIDTH - i); x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Right Triangle frame I.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
         pDst += i & 2;
         // check transparent pixels
         for (x = MICRO_WIDTH - i; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (!pixel.isTransparent()) {
+            if (!frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid non-transparent pixel in a Right Triangle frame I.");
-                return pDst;
+                return nullptr;
             }
         }
     }
@@ -342,21 +312,19 @@ quint8 *D1CelTilesetFrame::WriteRightTriangle(D1GfxFrame &frame, quint8 *pDst)
     for (i = 2; i != MICRO_HEIGHT; i += 2, y--) {
         // add opaque pixels
         for (x = 0; x < (MICRO_WIDTH - i); x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Right Triangle frame II.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
         pDst += i & 2;
         // check transparent pixels
         for (x = MICRO_WIDTH - i; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (!pixel.isTransparent()) {
+            if (!frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid non-transparent pixel in a Right Triangle frame II.");
-                return pDst;
+                return nullptr;
             }
         }
     }
@@ -373,33 +341,30 @@ quint8 *D1CelTilesetFrame::WriteLeftTrapezoid(D1GfxFrame &frame, quint8 *pDst)
     for (i = MICRO_HEIGHT - 2; i >= 0; i -= 2, y--) {
         // check transparent pixels
         for (x = 0; x < i; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (!pixel.isTransparent()) {
+            if (!frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid non-transparent pixel in a Left Trapezoid frame I.");
-                return pDst;
+                return nullptr;
             }
         }
         pDst += i & 2;
         // add opaque pixels
         for (x = i; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Left Trapezoid frame I.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
     }
     // add opaque pixels
     for (i = MICRO_HEIGHT / 2; i != 0; i--, y--) {
         for (x = 0; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Left Trapezoid frame II.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
     }
@@ -416,33 +381,30 @@ quint8 *D1CelTilesetFrame::WriteRightTrapezoid(D1GfxFrame &frame, quint8 *pDst)
     for (i = MICRO_HEIGHT - 2; i >= 0; i -= 2, y--) {
         // add opaque pixels
         for (x = 0; x < (MICRO_WIDTH - i); x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Right Trapezoid frame I.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
         pDst += i & 2;
         // check transparent pixels
         for (x = MICRO_WIDTH - i; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (!pixel.isTransparent()) {
+            if (!frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid non-transparent pixel in a Right Trapezoid frame I.");
-                return pDst;
+                return nullptr;
             }
         }
     }
     // add opaque pixels
     for (i = MICRO_HEIGHT / 2; i != 0; i--, y--) {
         for (x = 0; x < MICRO_WIDTH; x++) {
-            D1GfxPixel pixel = frame.getPixel(x, y);
-            if (pixel.isTransparent()) {
+            if (frame.isTransparent(x, y)) {
                 QMessageBox::critical(nullptr, "Error", "Invalid transparent pixel in a Right Trapezoid frame II.");
-                return pDst;
+                return nullptr;
             }
-            *pDst = pixel.getPaletteIndex();
+            *pDst = frame.getPaletteIndex(x, y);
             ++pDst;
         }
     }
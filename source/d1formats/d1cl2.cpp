@@ -1,26 +1,30 @@
 #include "d1cl2.h"
 
-#include <QBuffer>
 #include <QByteArray>
-#include <QDataStream>
 #include <QDebug>
 #include <QList>
 #include <QMessageBox>
+#include <QThread>
+#include <QtConcurrent>
 
-quint16 D1Cl2Frame::computeWidthFromHeader(QByteArray &rawFrameData, bool isClx)
-{
-    QDataStream in(rawFrameData);
-    in.setByteOrder(QDataStream::LittleEndian);
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "d1rowscanner.h"
 
-    quint16 celFrameHeaderSize;
-    in >> celFrameHeaderSize;
+quint16 D1Cl2Frame::computeWidthFromHeader(const D1DataView &rawFrameData, bool isClx)
+{
+    quint16 celFrameHeaderSize = rawFrameData.le16(0);
 
     if (celFrameHeaderSize & 1)
         return 0; // invalid header
 
     quint16 celFrameWidth = 0;
     if (isClx) {
-        in >> celFrameWidth;
+        celFrameWidth = rawFrameData.le16(2);
         return celFrameWidth;
     }
 
@@ -28,8 +32,7 @@ quint16 D1Cl2Frame::computeWidthFromHeader(QByteArray &rawFrameData, bool isClx)
     quint16 lastFrameOffset = celFrameHeaderSize;
     for (int i = 0; i < (celFrameHeaderSize / 2) - 1; i++) {
         quint16 pixelCount = 0;
-        quint16 nextFrameOffset;
-        in >> nextFrameOffset;
+        quint16 nextFrameOffset = rawFrameData.le16(2 + i * 2);
         if (nextFrameOffset == 0)
             break;
 
@@ -60,7 +63,7 @@ quint16 D1Cl2Frame::computeWidthFromHeader(QByteArray &rawFrameData, bool isClx)
     return celFrameWidth;
 }
 
-bool D1Cl2Frame::load(D1GfxFrame &frame, QByteArray rawData, bool isClx, const OpenAsParam &params)
+bool D1Cl2Frame::load(D1GfxFrame &frame, const D1DataView &rawData, bool isClx, const OpenAsParam &params)
 {
     if (rawData.size() == 0)
         return false;
@@ -69,10 +72,7 @@ bool D1Cl2Frame::load(D1GfxFrame &frame, QByteArray rawData, bool isClx, const O
 
     quint16 width = 0;
     if (params.clipped != OPEN_CLIPPED_TYPE::No) {
-        QDataStream in(rawData);
-        in.setByteOrder(QDataStream::LittleEndian);
-        quint16 offset;
-        in >> offset;
+        quint16 offset = rawData.le16(0);
         frameDataStartOffset += offset;
         // If header is present, try to compute frame width from frame header
         width = D1Cl2Frame::computeWidthFromHeader(rawData, isClx);
@@ -82,50 +82,65 @@ bool D1Cl2Frame::load(D1GfxFrame &frame, QByteArray rawData, bool isClx, const O
     if (frame.width == 0)
         return false;
 
-    // READ {CL2 FRAME DATA}
-
-    QList<D1GfxPixel> pixelLine;
+    // Count the pixels to allocate the frame in one go (incomplete pixel-lines are dropped)
+    int pixelCount = 0;
     for (int o = frameDataStartOffset; o < rawData.size(); o++) {
         quint8 readByte = rawData[o];
+        if (readByte > 0x00 && readByte < 0x80) {
+            pixelCount += readByte;
+        } else if (readByte >= 0x80 && readByte < 0xBF) {
+            pixelCount += 0xBF - readByte;
+            o++;
+        } else if (readByte >= 0xBF) {
+            pixelCount += 256 - readByte;
+            o += 256 - readByte;
+        }
+    }
+    frame.resize(frame.width, pixelCount / frame.width);
+
+    // READ {CL2 FRAME DATA}
+    // pixel-lines are stored bottom-up, transparent pixels are already set by resize
+    int x = 0;
+    int y = frame.height - 1;
+    for (int o = frameDataStartOffset; o < rawData.size() && y >= 0; o++) {
+        quint8 readByte = rawData[o];
 
         // Transparent pixels
         if (readByte > 0x00 && readByte < 0x80) {
-            for (int i = 0; i < readByte; i++) {
-                // Add transparent pixel
-                pixelLine.append(D1GfxPixel::transparentPixel());
-
-                if (pixelLine.size() == frame.width) {
-                    frame.pixels.insert(0, pixelLine);
-                    pixelLine.clear();
-                }
-            }
+            x += readByte;
+            y -= x / frame.width;
+            x %= frame.width;
         }
         // Repeat palette index
         else if (readByte >= 0x80 && readByte < 0xBF) {
             // Go to the palette index offset
             o++;
+            if (o >= rawData.size())
+                break;
 
-            for (int i = 0; i < (0xBF - readByte); i++) {
+            for (int i = 0; i < (0xBF - readByte) && y >= 0; i++) {
                 // Add opaque pixel
-                pixelLine.append(D1GfxPixel::colorPixel(rawData[o]));
+                frame.setPixel(x, y, rawData[o]);
 
-                if (pixelLine.size() == frame.width) {
-                    frame.pixels.insert(0, pixelLine);
-                    pixelLine.clear();
+                if (++x == frame.width) {
+                    x = 0;
+                    y--;
                 }
             }
         }
         // Palette indices
         else if (readByte >= 0xBF) {
-            for (int i = 0; i < (256 - readByte); i++) {
+            for (int i = 0; i < (256 - readByte) && y >= 0; i++) {
                 // Go to the next palette index offset
                 o++;
+                if (o >= rawData.size())
+                    break;
                 // Add opaque pixel
-                pixelLine.append(D1GfxPixel::colorPixel(rawData[o]));
+                frame.setPixel(x, y, rawData[o]);
 
-                if (pixelLine.size() == frame.width) {
-                    frame.pixels.insert(0, pixelLine);
-                    pixelLine.clear();
+                if (++x == frame.width) {
+                    x = 0;
+                    y--;
                 }
             }
         } else if (readByte == 0x00) {
@@ -133,75 +148,57 @@ bool D1Cl2Frame::load(D1GfxFrame &frame, QByteArray rawData, bool isClx, const O
         }
     }
 
-    frame.height = frame.pixels.size();
-
     return true;
 }
 
 bool D1Cl2::load(D1Gfx &gfx, QString filePath, bool isClx, const OpenAsParam &params)
 {
-    // Opening CL2 file with a QBuffer to load it in RAM
+    // Opening CL2 file with a memory mapping
     if (!QFile::exists(filePath))
         return false;
 
-    QFile file = QFile(filePath);
-
-    if (!file.open(QIODevice::ReadOnly))
-        return false;
-
-    QByteArray fileData = file.readAll();
-    QBuffer fileBuffer(&fileData);
-
-    if (!fileBuffer.open(QIODevice::ReadOnly))
+    std::unique_ptr<D1FileData> file = std::make_unique<D1FileData>();
+    if (!file->open(filePath))
         return false;
 
     // Read CL2 binary data
-    QDataStream in(&fileBuffer);
-    in.setByteOrder(QDataStream::LittleEndian);
+    const D1DataView in = file->view();
 
     // CL2 HEADER CHECKS
 
-    quint32 firstDword;
-    in >> firstDword;
+    quint32 firstDword = in.le32(0);
 
     // Trying to find file size in CL2 header
-    if (fileBuffer.size() < (firstDword * 4 + 4 + 4))
+    if (in.size() < (firstDword * 4 + 4 + 4))
         return false;
 
-    fileBuffer.seek(firstDword * 4 + 4);
-    quint32 fileSizeDword;
-    in >> fileSizeDword;
+    quint32 fileSizeDword = in.le32(firstDword * 4 + 4);
 
     // If the dword is not equal to the file size then
     // check if it's a CL2 with multiple groups
-    bool isMultiGroup = fileBuffer.size() != fileSizeDword;
+    bool isMultiGroup = in.size() != fileSizeDword;
     if (isMultiGroup) {
         // Read offset of the last CL2 group header
-        fileBuffer.seek(firstDword - 4);
-        quint32 lastCl2GroupHeaderOffset;
-        in >> lastCl2GroupHeaderOffset;
+        quint32 lastCl2GroupHeaderOffset = in.le32(firstDword - 4);
 
         // Read the number of frames of the last CL2 group
-        if (fileBuffer.size() < lastCl2GroupHeaderOffset)
+        if (in.size() < lastCl2GroupHeaderOffset)
             return false;
 
-        fileBuffer.seek(lastCl2GroupHeaderOffset);
-        quint32 lastCl2GroupFrameCount;
-        in >> lastCl2GroupFrameCount;
+        quint32 lastCl2GroupFrameCount = in.le32(lastCl2GroupHeaderOffset);
 
         // Read the last frame offset corresponding to the file size
-        if (fileBuffer.size()
+        if (in.size()
             < lastCl2GroupHeaderOffset + lastCl2GroupFrameCount * 4 + 4 + 4)
             return false;
 
-        fileBuffer.seek(lastCl2GroupHeaderOffset + lastCl2GroupFrameCount * 4 + 4);
-        in >> fileSizeDword;
+        fileSizeDword = in.le32(lastCl2GroupHeaderOffset + lastCl2GroupFrameCount * 4 + 4);
         // The offset is from the beginning of the last group header
         // so we need to add the offset of the lasr group header
         // to have an offset from the beginning of the file
         fileSizeDword += lastCl2GroupHeaderOffset;
 
-        if (fileBuffer.size() != fileSizeDword) {
+        if (in.size() != fileSizeDword) {
             return false;
         }
     }
@@ -213,13 +210,8 @@ bool D1Cl2::load(D1Gfx &gfx, QString filePath, bool isClx, const OpenAsParam &pa
     if (isMultiGroup) {
         // Going through all groups
         for (unsigned i = 0; i * 4 < firstDword; i++) {
-            fileBuffer.seek(i * 4);
-            quint32 cl2GroupOffset;
-            in >> cl2GroupOffset;
-
-            fileBuffer.seek(cl2GroupOffset);
-            quint32 cl2GroupFrameCount;
-            in >> cl2GroupFrameCount;
+            quint32 cl2GroupOffset = in.le32(i * 4);
+            quint32 cl2GroupFrameCount = in.le32(cl2GroupOffset);
 
             gfx.groupFrameIndices.append(
                 qMakePair(frameOffsets.size(),
@@ -227,11 +219,8 @@ bool D1Cl2::load(D1Gfx &gfx, QString filePath, bool isClx, const OpenAsParam &pa
 
             // Going through all frames of the group
             for (unsigned j = 1; j <= cl2GroupFrameCount; j++) {
-                fileBuffer.seek(cl2GroupOffset + j * 4);
-                quint32 cl2FrameStartOffset;
-                in >> cl2FrameStartOffset;
-                quint32 cl2FrameEndOffset;
-                in >> cl2FrameEndOffset;
+                quint32 cl2FrameStartOffset = in.le32(cl2GroupOffset + j * 4);
+                quint32 cl2FrameEndOffset = in.le32(cl2GroupOffset + j * 4 + 4);
 
                 frameOffsets.append(
                     qMakePair(cl2GroupOffset + cl2FrameStartOffset,
@@ -242,11 +231,8 @@ bool D1Cl2::load(D1Gfx &gfx, QString filePath, bool isClx, const OpenAsParam &pa
         // Going through all frames of the only group
         gfx.groupFrameIndices.append(qMakePair(0, firstDword - 1));
         for (unsigned i = 1; i <= firstDword; i++) {
-            fileBuffer.seek(i * 4);
-            quint32 cl2FrameStartOffset;
-            in >> cl2FrameStartOffset;
-            quint32 cl2FrameEndOffset;
-            in >> cl2FrameEndOffset;
+            quint32 cl2FrameStartOffset = in.le32(i * 4);
+            quint32 cl2FrameEndOffset = in.le32(i * 4 + 4);
 
             frameOffsets.append(
                 qMakePair(cl2FrameStartOffset, cl2FrameEndOffset));
@@ -255,20 +241,15 @@ bool D1Cl2::load(D1Gfx &gfx, QString filePath, bool isClx, const OpenAsParam &pa
 
     // BUILDING {CL2 FRAMES}
 
-    gfx.frames.clear();
+    // the frames are decoded on demand directly from the mapped file
+    gfx.clearFrames();
     for (const auto &offset : frameOffsets) {
-        quint32 cl2FrameSize = offset.second - offset.first;
-        fileBuffer.seek(offset.first);
-
-        QByteArray cl2FrameRawData = fileBuffer.read(cl2FrameSize);
-
-        D1GfxFrame frame;
-        if (!D1Cl2Frame::load(frame, cl2FrameRawData, isClx, params)) {
-            qDebug() << "Failed to load frame: " << gfx.frames.count();
-            frame = {};
-        }
-        gfx.frames.append(frame);
+        gfx.appendEncodedFrame(offset.first, offset.second > offset.first ? offset.second - offset.first : 0);
     }
+    gfx.encodedFile = std::move(file);
+    gfx.frameDecoder = [isClx, params](D1GfxFrame &frame, const D1DataView &rawData) {
+        return D1Cl2Frame::load(frame, rawData, isClx, params);
+    };
 
     gfx.gfxFilePath = filePath;
     return true;
@@ -294,26 +275,22 @@ quint8 *AppendClxFillRun(uint8_t color, unsigned width, quint8 *pBuf)
     return pBuf;
 }
 
-quint8 *AppendClxPixelsRun(D1GfxFrame *frame, int x, int y, unsigned width, quint8 *pBuf)
+quint8 *AppendClxPixelsRun(const quint8 *src, unsigned width, quint8 *pBuf)
 {
     while (width >= 0x41) {
         *pBuf = 0xBF;
         pBuf++;
-        for (int i = 0; i < 0x41; ++i) {
-            *pBuf = frame->getPixel(x + i, y).getPaletteIndex();
-            pBuf++;
-        }
+        memcpy(pBuf, src, 0x41);
+        pBuf += 0x41;
+        src += 0x41;
         width -= 0x41;
-        x += 0x41;
     }
     if (width == 0)
         return pBuf;
     *pBuf = 256 - width;
     pBuf++;
-    for (int i = 0; i < width; ++i) {
-        *pBuf = frame->getPixel(x + i, y).getPaletteIndex();
-        pBuf++;
-    }
+    memcpy(pBuf, src, width);
+    pBuf += width;
 
     return pBuf;
 }
@@ -332,49 +309,93 @@ quint8 *AppendClxTransparentRun(unsigned width, quint8 *pBuf)
     return pBuf;
 }
 
-quint8 *AppendClxPixelsOrFillRun(D1GfxFrame *frame, int x, int y, unsigned length, quint8 *pBuf)
+quint8 *AppendClxPixelsOrFillRun(const quint8 *indexRow, int x, unsigned length, quint8 *pBuf)
 {
+    const int endX = x + length;
     int beginX = x;
-    int prevColorX = x;
-    unsigned prevColorRunLength = 1;
-    uint8_t prevColor = frame->getPixel(x, y).getPaletteIndex();
-    x++;
-    while (--length > 0) {
-        const uint8_t color = frame->getPixel(x, y).getPaletteIndex();
-        if (prevColor == color) {
-            ++prevColorRunLength;
-        } else {
-            // A tunable parameter that decides at which minimum length we encode a fill run.
-            // 3 appears to be optimal for most of our data (much better than 2, rarely very slightly worse than 4).
-            constexpr unsigned MinFillRunLength = 3;
-            if (prevColorRunLength >= MinFillRunLength) {
-                pBuf = AppendClxPixelsRun(frame, beginX, y, prevColorX - beginX, pBuf);
-                pBuf = AppendClxFillRun(prevColor, prevColorRunLength, pBuf);
-                beginX = x;
+    while (x < endX) {
+        const unsigned colorRunLength = D1RowScanner::equalRunLength(indexRow, x, endX);
+        if (x + (int)colorRunLength == endX) {
+            // Here we use 2 instead of `MinFillRunLength` because we know that this run
+            // is followed by transparent pixels.
+            // Width=2 Fill command takes 2 bytes, while the Pixels command is 3 bytes.
+            if (colorRunLength >= 2) {
+                pBuf = AppendClxPixelsRun(&indexRow[beginX], x - beginX, pBuf);
+                pBuf = AppendClxFillRun(indexRow[x], colorRunLength, pBuf);
+            } else {
+                pBuf = AppendClxPixelsRun(&indexRow[beginX], endX - beginX, pBuf);
             }
-            prevColorX = x;
-            prevColorRunLength = 1;
-            prevColor = color;
+            break;
+        }
+        // A tunable parameter that decides at which minimum length we encode a fill run.
+        // 3 appears to be optimal for most of our data (much better than 2, rarely very slightly worse than 4).
+        constexpr unsigned MinFillRunLength = 3;
+        if (colorRunLength >= MinFillRunLength) {
+            pBuf = AppendClxPixelsRun(&indexRow[beginX], x - beginX, pBuf);
+            pBuf = AppendClxFillRun(indexRow[x], colorRunLength, pBuf);
+            beginX = x + colorRunLength;
         }
-        x++;
+        x += colorRunLength;
     }
+    return pBuf;
+}
 
-    // Here we use 2 instead of `MinFillRunLength` because we know that this run
-    // is followed by transparent pixels.
-    // Width=2 Fill command takes 2 bytes, while the Pixels command is 3 bytes.
-    if (prevColorRunLength >= 2) {
-        pBuf = AppendClxPixelsRun(frame, beginX, y, prevColorX - beginX, pBuf);
-        pBuf = AppendClxFillRun(prevColor, prevColorRunLength, pBuf);
-    } else {
-        pBuf = AppendClxPixelsRun(frame, beginX, y, prevColorX - beginX + prevColorRunLength, pBuf);
+// Size-optimal variant of AppendClxPixelsOrFillRun
+// Dynamic programming over the pixels and fill commands: cost[i] is the smallest number of bytes to encode the pixels from x + i to the end of the run.
+quint8 *AppendClxPixelsOrFillRunOptimal(const quint8 *indexRow, int x, unsigned length, std::vector<unsigned> &cost, std::vector<int> &choice, quint8 *pBuf)
+{
+    const quint8 *src = &indexRow[x];
+    cost.assign(length + 1, 0);
+    choice.assign(length, 0);
+    unsigned colorRunLength = 0;
+    for (int i = length - 1; i >= 0; i--) {
+        // number of pixels with the color of src[i]
+        colorRunLength = (i + 1 < (int)length && src[i] == src[i + 1]) ? colorRunLength + 1 : 1;
+        // Pixels command: one byte + the palette indices (a positive choice)
+        unsigned bestCost = UINT_MAX;
+        int bestChoice = 0;
+        const int maxPixels = std::min(0x41, (int)length - i);
+        for (int n = 1; n <= maxPixels; n++) {
+            const unsigned c = 1 + n + cost[i + n];
+            if (c < bestCost) {
+                bestCost = c;
+                bestChoice = n;
+            }
+        }
+        // Fill command: two bytes (a negative choice)
+        const int maxFill = std::min(0x3F, (int)colorRunLength);
+        for (int n = 2; n <= maxFill; n++) {
+            const unsigned c = 2 + cost[i + n];
+            if (c < bestCost) {
+                bestCost = c;
+                bestChoice = -n;
+            }
+        }
+        cost[i] = bestCost;
+        choice[i] = bestChoice;
+    }
+
+    for (unsigned i = 0; i < length;) {
+        const int n = choice[i];
+        if (n > 0) {
+            pBuf = AppendClxPixelsRun(&src[i], n, pBuf);
+            i += n;
+        } else {
+            pBuf = AppendClxFillRun(src[i], -n, pBuf);
+            i -= n;
+        }
     }
     return pBuf;
 }
 
 } // namespace
 
-static quint8 *writeFrameData(D1GfxFrame *frame, quint8 *pBuf, bool isClx, int subHeaderSize)
+static quint8 *writeFrameData(const D1GfxFrame *frame, quint8 *pBuf, bool isClx, int subHeaderSize, D1CL2_ENCODING encoding)
 {
+    // scratch buffers of the optimal encoder
+    std::vector<unsigned> cost;
+    std::vector<int> choice;
+
     // convert one image to cl2-data
     quint16 *pHeader = reinterpret_cast<quint16 *>(pBuf);
     // add CL2 FRAME HEADER
@@ -399,25 +420,26 @@ static quint8 *writeFrameData(D1GfxFrame *frame, quint8 *pBuf, bool isClx, int s
             }
         }
         int y = frame->getHeight() - i;
+        const quint8 *indexRow = frame->getIndexRow(y);
+        const quint8 *maskRow = frame->getMaskRow(y);
         // Process line:
-        unsigned solidRunWidth = 0;
-        for (int x = 0; x < frame->getWidth(); x++) {
-            D1GfxPixel pixel = frame->getPixel(x, y);
-            if (pixel.isTransparent()) {
-                if (solidRunWidth != 0) {
-                    pBuf = AppendClxPixelsOrFillRun(frame, x - transparentRunWidth - solidRunWidth, y, solidRunWidth, pBuf);
-                    solidRunWidth = 0;
-                }
-                ++transparentRunWidth;
+        for (int x = 0; x < frame->getWidth();) {
+            if (frame->isTransparent(x, y)) {
+                const int runWidth = D1RowScanner::transparentRunLength(maskRow, x, frame->getWidth());
+                transparentRunWidth += runWidth;
+                x += runWidth;
             } else {
                 pBuf = AppendClxTransparentRun(transparentRunWidth, pBuf);
                 transparentRunWidth = 0;
-                ++solidRunWidth;
+                const int solidRunWidth = D1RowScanner::opaqueRunLength(maskRow, x, frame->getWidth());
+                if (encoding == D1CL2_ENCODING::OPTIMAL) {
+                    pBuf = AppendClxPixelsOrFillRunOptimal(indexRow, x, solidRunWidth, cost, choice, pBuf);
+                } else {
+                    pBuf = AppendClxPixelsOrFillRun(indexRow, x, solidRunWidth, pBuf);
+                }
+                x += solidRunWidth;
             }
         }
-        if (solidRunWidth != 0) {
-            pBuf = AppendClxPixelsOrFillRun(frame, frame->getWidth() - solidRunWidth, y, solidRunWidth, pBuf);
-        }
     }
     pBuf = AppendClxTransparentRun(transparentRunWidth, pBuf);
     if (isClx) {
@@ -427,46 +449,92 @@ static quint8 *writeFrameData(D1GfxFrame *frame, quint8 *pBuf, bool isClx, int s
     return pBuf;
 }
 
-bool D1Cl2::writeFileData(D1Gfx &gfx, QFile &outFile, bool isClx, const QString &gfxPath)
+static QByteArray encodeFrame(const D1GfxFrame *frame, bool isClx, int subHeaderSize, D1CL2_ENCODING encoding)
+{
+    // worst case: two bytes per pixel plus the transparent runs flushed at the start of each block
+    const int height = frame->getHeight();
+    std::vector<quint8> buf(subHeaderSize + 2 * frame->getWidth() * height + height / CEL_BLOCK_HEIGHT + 2, 0);
+    quint8 *pEnd = writeFrameData(frame, buf.data(), isClx, subHeaderSize, encoding);
+    return QByteArray(reinterpret_cast<const char *>(buf.data()), pEnd - buf.data());
+}
+
+bool D1Cl2::writeFileData(D1Gfx &gfx, D1FileWriter &writer, bool isClx, D1CL2_ENCODING encoding, qint64 *bytesSaved)
 {
     const int numFrames = gfx.frames.count();
 
     // calculate header size
     int headerSize = 0;
+    int numGroupFrames = 0;
     int numGroups = gfx.getGroupCount();
     bool groupped = numGroups > 1;
     for (int i = 0; i < numGroups; i++) {
         QPair<quint16, quint16> gfi = gfx.getGroupFrameIndices(i);
         int ni = gfi.second - gfi.first + 1;
         headerSize += 4 + 4 * (ni + 1);
+        numGroupFrames += ni;
     }
     if (groupped) {
         headerSize += sizeof(quint32) * numGroups;
     }
+    // TODO: what if the groups are not continuous?
+    numGroupFrames = std::min(numGroupFrames, numFrames);
 
     // calculate sub header size
     int subHeaderSize = !isClx ? SUB_HEADER_SIZE : 6;
     if (!isClx) {
         for (int n = 0; n < numFrames; n++) {
-            D1GfxFrame *frame = gfx.getFrame(n);
-            int hs = (frame->getHeight() - 1) / CEL_BLOCK_HEIGHT;
+            // the size of an evicted frame is known without decoding it again
+            int hs = (gfx.getFrameHeight(n) - 1) / CEL_BLOCK_HEIGHT;
             hs = (hs + 1) * sizeof(quint16);
             subHeaderSize = std::max(subHeaderSize, hs);
         }
     }
 
-    // estimate data size
-    int maxSize = headerSize;
-    for (int n = 0; n < numFrames; n++) {
-        D1GfxFrame *frame = gfx.getFrame(n);
-        maxSize += subHeaderSize; // SUB_HEADER_SIZE
-        maxSize += frame->getHeight() * (2 * frame->getWidth());
+    // the header is written after the frames, once the offsets are known
+    writer.reserve(headerSize);
+    writer.advance(headerSize);
+
+    // encode the frames concurrently in batches, so only a few decoded and encoded frames are kept in memory
+    // (the workers read shallow copies, so an eviction in gfx can not free the planes under them)
+    QList<D1GfxFrame> frames;
+    std::vector<quint32> frameSizes(numGroupFrames);
+    if (bytesSaved != nullptr) {
+        *bytesSaved = 0;
+    }
+    const int batchSize = std::max(1, QThread::idealThreadCount());
+    std::vector<QByteArray> encodedFrames(batchSize);
+    // size of the frames with the greedy encoder to report the gain of the optimal one
+    std::vector<qint64> greedySizes(batchSize, 0);
+    std::vector<int> frameIndices;
+    for (int first = 0; first < numGroupFrames; first += batchSize) {
+        frameIndices.resize(std::min(batchSize, numGroupFrames - first));
+        std::iota(frameIndices.begin(), frameIndices.end(), 0);
+        frames.clear();
+        for (int i : frameIndices) {
+            frames.append(*gfx.getFrame(first + i));
+        }
+        QtConcurrent::blockingMap(frameIndices, [&](int i) {
+            const D1GfxFrame *frame = &frames.at(i);
+            encodedFrames[i] = encodeFrame(frame, isClx, subHeaderSize, encoding);
+            if (bytesSaved != nullptr) {
+                greedySizes[i] = encoding == D1CL2_ENCODING::GREEDY ? encodedFrames[i].size() : encodeFrame(frame, isClx, subHeaderSize, D1CL2_ENCODING::GREEDY).size();
+            }
+        });
+        for (int i : frameIndices) {
+            writer.write(encodedFrames[i].constData(), encodedFrames[i].size());
+            frameSizes[first + i] = encodedFrames[i].size();
+            if (bytesSaved != nullptr) {
+                *bytesSaved += greedySizes[i] - encodedFrames[i].size();
+            }
+            encodedFrames[i].clear();
+        }
     }
 
-    QByteArray fileData;
-    fileData.append(maxSize, 0);
+    // calculate the headers
+    QByteArray headerData;
+    headerData.fill(0, headerSize);
 
-    quint8 *buf = (quint8 *)fileData.data();
+    quint8 *buf = (quint8 *)headerData.data();
     quint8 *hdr = buf;
     if (groupped) {
         // add optional {CL2 GROUP HEADER}
@@ -479,38 +547,42 @@ bool D1Cl2::writeFileData(D1Gfx &gfx, QFile &outFile, bool isClx, const QString
         }
     }
 
-    quint8 *pBuf = &buf[headerSize];
+    quint32 fileOffset = headerSize;
     int idx = 0;
     for (int ii = 0; ii < numGroups; ii++) {
         QPair<quint16, quint16> gfi = gfx.getGroupFrameIndices(ii);
         int ni = gfi.second - gfi.first + 1;
+        quint32 hdrOffset = hdr - buf;
         *(quint32 *)&hdr[0] = SwapLE32(ni);
-        *(quint32 *)&hdr[4] = SwapLE32(pBuf - hdr);
+        *(quint32 *)&hdr[4] = SwapLE32(fileOffset - hdrOffset);
 
-        for (int n = 0; n < ni; n++, idx++) {
-            D1GfxFrame *frame = gfx.getFrame(idx); // TODO: what if the groups are not continuous?
-            pBuf = writeFrameData(frame, pBuf, isClx, subHeaderSize);
-            *(quint32 *)&hdr[4 + 4 * (n + 1)] = SwapLE32(pBuf - hdr);
+        for (int n = 0; n < ni && idx < numGroupFrames; n++, idx++) {
+            fileOffset += frameSizes[idx];
+            *(quint32 *)&hdr[4 + 4 * (n + 1)] = SwapLE32(fileOffset - hdrOffset);
         }
         hdr += 4 + 4 * (ni + 1);
     }
-
-    // write to file
-    QDataStream out(&outFile);
-    out.writeRawData((char *)buf, pBuf - buf);
+    writer.writeAt(0, headerData);
 
     return true;
 }
 
-bool D1Cl2::save(D1Gfx &gfx, bool isClx, const QString &gfxPath)
+bool D1Cl2::save(D1Gfx &gfx, bool isClx, const QString &gfxPath, D1CL2_ENCODING encoding, qint64 *bytesSaved)
 {
-    QFile outFile = QFile(gfxPath);
-    if (!outFile.open(QIODevice::WriteOnly | QFile::Truncate)) {
+    // the frames are encoded in batches, decoded on demand from the source file (within the limit of the decoded frames)
+    D1FileWriter writer;
+    if (!writer.open(gfxPath)) {
         QMessageBox::critical(nullptr, "Error", "Failed open file: " + gfxPath);
         return false;
     }
 
-    bool success = D1Cl2::writeFileData(gfx, outFile, isClx, gfxPath);
+    bool success = D1Cl2::writeFileData(gfx, writer, isClx, encoding, bytesSaved);
+    if (success)
+        gfx.releaseEncodedFile(gfxPath);
+    if (success && !writer.commit()) {
+        QMessageBox::critical(nullptr, "Error", "Failed to write file: " + gfxPath);
+        success = false;
+    }
 
     if (success) {
         gfx.modified = false;
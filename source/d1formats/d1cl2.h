@@ -1,26 +1,33 @@
 #pragma once
 
-#include <QFile>
 #include <QString>
 
+#include "d1dataview.h"
+#include "d1filewriter.h"
 #include "d1gfx.h"
 #include "dialogs/openasdialog.h"
 
+enum class D1CL2_ENCODING {
+    GREEDY,
+    OPTIMAL,
+};
+
 class D1Cl2Frame {
     friend class D1Cl2;
 
 public:
-    static bool load(D1GfxFrame &frame, QByteArray rawFrameData, bool isClx, const OpenAsParam &params);
+    static bool load(D1GfxFrame &frame, const D1DataView &rawFrameData, bool isClx, const OpenAsParam &params);
 
 private:
-    static quint16 computeWidthFromHeader(QByteArray &rawFrameData, bool isClx);
+    static quint16 computeWidthFromHeader(const D1DataView &rawFrameData, bool isClx);
 };
 
 class D1Cl2 {
 public:
     static bool load(D1Gfx &gfx, QString cl2FilePath, bool isClx, const OpenAsParam &params);
-    static bool save(D1Gfx &gfx, bool isClx, const QString &gfxPath);
+    // bytesSaved (optional) receives the number of bytes saved compared to the greedy encoder
+    static bool save(D1Gfx &gfx, bool isClx, const QString &gfxPath, D1CL2_ENCODING encoding = D1CL2_ENCODING::GREEDY, qint64 *bytesSaved = nullptr);
 
 protected:
-    static bool writeFileData(D1Gfx &gfx, QFile &outFile, bool isClx, const QString &gfxPath);
+    static bool writeFileData(D1Gfx &gfx, D1FileWriter &writer, bool isClx, D1CL2_ENCODING encoding, qint64 *bytesSaved);
 };
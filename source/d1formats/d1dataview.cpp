@@ -0,0 +1,100 @@
+#include "d1dataview.h"
+
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <algorithm>
+
+D1DataView::D1DataView(const quint8 *data, qint64 size)
+    : ptr(data)
+    , len(size)
+{
+}
+
+const quint8 *D1DataView::data() const
+{
+    return this->ptr;
+}
+
+qint64 D1DataView::size() const
+{
+    return this->len;
+}
+
+bool D1DataView::isEmpty() const
+{
+    return this->len == 0;
+}
+
+quint8 D1DataView::operator[](qint64 offset) const
+{
+    if (offset < 0 || offset >= this->len)
+        return 0;
+
+    return this->ptr[offset];
+}
+
+quint16 D1DataView::le16(qint64 offset) const
+{
+    if (offset < 0 || offset + 2 > this->len)
+        return 0;
+
+    return qFromLittleEndian<quint16>(&this->ptr[offset]);
+}
+
+quint32 D1DataView::le32(qint64 offset) const
+{
+    if (offset < 0 || offset + 4 > this->len)
+        return 0;
+
+    return qFromLittleEndian<quint32>(&this->ptr[offset]);
+}
+
+D1DataView D1DataView::mid(qint64 offset, qint64 length) const
+{
+    if (offset < 0 || offset >= this->len || length <= 0)
+        return D1DataView();
+
+    return D1DataView(&this->ptr[offset], std::min(length, this->len - offset));
+}
+
+bool D1FileData::open(const QString &filePath)
+{
+    this->file.setFileName(filePath);
+    if (!this->file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 fileSize = this->file.size();
+    const uchar *mapping = fileSize != 0 ? this->file.map(0, fileSize) : nullptr;
+    if (mapping != nullptr) {
+        this->data = D1DataView(mapping, fileSize);
+    } else {
+        // e.g. empty files or files on a device which does not support mapping
+        this->fileContent = this->file.readAll();
+        this->data = D1DataView(reinterpret_cast<const quint8 *>(this->fileContent.constData()), this->fileContent.size());
+    }
+    return true;
+}
+
+bool D1FileData::isFile(const QString &filePath) const
+{
+    return this->file.isOpen() && QFileInfo(this->file.fileName()) == QFileInfo(filePath);
+}
+
+// copies the mapped content to memory and closes the file
+void D1FileData::detach()
+{
+    if (!this->file.isOpen())
+        return;
+
+    if (this->fileContent.isEmpty() && !this->data.isEmpty()) {
+        this->fileContent = QByteArray(reinterpret_cast<const char *>(this->data.data()), this->data.size());
+        this->data = D1DataView(reinterpret_cast<const quint8 *>(this->fileContent.constData()), this->fileContent.size());
+    }
+    this->file.close(); // unmaps the file
+}
+
+D1DataView D1FileData::view() const
+{
+    return this->data;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// Non-owning view of little-endian binary data
+// Every read is bounds-checked: out-of-range reads return 0 and sub-views are clamped to the available data.
+class D1DataView {
+public:
+    D1DataView() = default;
+    D1DataView(const quint8 *data, qint64 size);
+    ~D1DataView() = default;
+
+    const quint8 *data() const;
+    qint64 size() const;
+    bool isEmpty() const;
+
+    quint8 operator[](qint64 offset) const;
+    quint16 le16(qint64 offset) const;
+    quint32 le32(qint64 offset) const;
+    D1DataView mid(qint64 offset, qint64 length) const;
+
+private:
+    const quint8 *ptr = nullptr;
+    qint64 len = 0;
+};
+
+// Read-only content of a file, memory-mapped if possible
+class D1FileData {
+public:
+    D1FileData() = default;
+    ~D1FileData() = default;
+
+    bool open(const QString &filePath);
+    // whether the data is still read from the given file
+    bool isFile(const QString &filePath) const;
+    void detach();
+    D1DataView view() const;
+
+private:
+    QFile file;
+    D1DataView data;
+    // fallback if the file can not be mapped
+    QByteArray fileContent;
+};
@@ -0,0 +1,93 @@
+#include "d1filewriter.h"
+
+#include <cstring>
+
+#define CHUNK_SIZE (64 * 1024)
+
+bool D1FileWriter::open(const QString &filePath)
+{
+    this->file.setFileName(filePath);
+    if (!this->file.open(QIODevice::WriteOnly))
+        return false;
+
+    this->chunk.resize(CHUNK_SIZE);
+    this->chunkUsed = 0;
+    this->flushedSize = 0;
+    this->failed = false;
+    return true;
+}
+
+bool D1FileWriter::commit()
+{
+    this->flush();
+    if (this->failed) {
+        this->cancel();
+        return false;
+    }
+    return this->file.commit();
+}
+
+void D1FileWriter::cancel()
+{
+    this->file.cancelWriting();
+    this->file.commit(); // discards the temporary file
+}
+
+qint64 D1FileWriter::pos() const
+{
+    return this->flushedSize + this->chunkUsed;
+}
+
+quint8 *D1FileWriter::reserve(int size)
+{
+    if (this->chunkUsed + size > (int)this->chunk.size()) {
+        this->flush();
+        if (size > (int)this->chunk.size()) {
+            this->chunk.resize(size);
+        }
+    }
+    quint8 *buf = &this->chunk[this->chunkUsed];
+    memset(buf, 0, size);
+    return buf;
+}
+
+void D1FileWriter::advance(int size)
+{
+    this->chunkUsed += size;
+}
+
+void D1FileWriter::write(const char *data, int size)
+{
+    memcpy(this->reserve(size), data, size);
+    this->advance(size);
+}
+
+void D1FileWriter::writeAt(qint64 offset, const QByteArray &data)
+{
+    if (offset >= this->flushedSize) {
+        // still in the buffer
+        memcpy(&this->chunk[offset - this->flushedSize], data.constData(), data.size());
+        return;
+    }
+    this->flush();
+    if (!this->file.seek(offset) || this->file.write(data) != data.size() || !this->file.seek(this->flushedSize)) {
+        this->failed = true;
+    }
+}
+
+void D1FileWriter::flush()
+{
+    if (this->chunkUsed == 0)
+        return;
+
+    if (this->file.write(reinterpret_cast<const char *>(this->chunk.data()), this->chunkUsed) != this->chunkUsed) {
+        this->failed = true;
+    }
+    this->flushedSize += this->chunkUsed;
+    this->chunkUsed = 0;
+    // do not keep the buffer of an oversized frame
+    if (this->chunk.size() > CHUNK_SIZE) {
+        this->chunk.resize(CHUNK_SIZE);
+        this->chunk.shrink_to_fit();
+    }
+}
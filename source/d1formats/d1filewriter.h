@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QByteArray>
+#include <QSaveFile>
+#include <QString>
+
+#include <vector>
+
+// Buffered writer which replaces the target file atomically
+// The data is streamed through a chunk buffer, the original file is left untouched unless commit succeeds.
+class D1FileWriter {
+public:
+    D1FileWriter() = default;
+    ~D1FileWriter() = default;
+
+    bool open(const QString &filePath);
+    bool commit();
+    // discard the written data (the target file is not touched)
+    void cancel();
+
+    qint64 pos() const;
+    // zero-filled buffer of (at least) size bytes at the current position
+    quint8 *reserve(int size);
+    // move the current position after the bytes written to the reserved buffer
+    void advance(int size);
+    void write(const char *data, int size);
+    // overwrite already written data (e.g. the offsets of a header)
+    void writeAt(qint64 offset, const QByteArray &data);
+
+private:
+    void flush();
+
+    QSaveFile file;
+    std::vector<quint8> chunk;
+    int chunkUsed = 0;
+    qint64 flushedSize = 0;
+    bool failed = false;
+};
@@ -1,8 +1,17 @@
 #include "d1gfx.h"
 
+#include <QDebug>
 #include <QPainter>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include <vector>
 
 #include "d1image.h"
+#include "d1rowscanner.h"
 
 namespace {
 
@@ -71,12 +80,132 @@ int D1GfxFrame::getHeight() const
 
 D1GfxPixel D1GfxFrame::getPixel(int x, int y) const
 {
-    if (x >= 0 && x < this->width && y >= 0 && y < this->height)
-        return this->pixels[y][x];
+    if (x >= 0 && x < this->width && y >= 0 && y < this->height) {
+        if (this->isTransparent(x, y))
+            return D1GfxPixel::transparentPixel();
+        return D1GfxPixel::colorPixel(this->getPaletteIndex(x, y));
+    }
 
     return D1GfxPixel::transparentPixel();
 }
 
+bool D1GfxFrame::isTransparent(int x, int y) const
+{
+    return (this->getMaskRow(y)[x >> 3] >> (x & 7)) & 1;
+}
+
+quint8 D1GfxFrame::getPaletteIndex(int x, int y) const
+{
+    return this->getIndexRow(y)[x];
+}
+
+const quint8 *D1GfxFrame::getIndexRow(int y) const
+{
+    return reinterpret_cast<const quint8 *>(this->indices.constData()) + y * this->width;
+}
+
+const quint8 *D1GfxFrame::getMaskRow(int y) const
+{
+    return reinterpret_cast<const quint8 *>(this->mask.constData()) + y * this->maskStride;
+}
+
+int D1GfxFrame::getMaskStride() const
+{
+    return this->maskStride;
+}
+
+bool D1GfxFrame::isRowOpaque(int y) const
+{
+    const quint8 *maskRow = this->getMaskRow(y);
+    int x = 0;
+    for (; x + 8 <= this->width; x += 8) {
+        if (maskRow[x >> 3] != 0)
+            return false;
+    }
+    // the padding bits are always set
+    return x == this->width || (maskRow[x >> 3] & ((1 << (this->width - x)) - 1)) == 0;
+}
+
+bool D1GfxFrame::isRowTransparent(int y) const
+{
+    const quint8 *maskRow = this->getMaskRow(y);
+    for (int i = 0; i < this->maskStride; i++) {
+        if (maskRow[i] != 0xFF)
+            return false;
+    }
+    return true;
+}
+
+// compares the pixels of the frames (transparent pixels always hold index 0 and the padding bits are always set)
+bool D1GfxFrame::pixelsEqual(const D1GfxFrame &other) const
+{
+    return this->width == other.width && this->height == other.height
+        && this->indices == other.indices && this->mask == other.mask;
+}
+
+// 64-bit FNV-1a hash of the pixels (equal frames have equal hashes)
+quint64 D1GfxFrame::getContentHash() const
+{
+    quint64 hash = 14695981039346656037ULL;
+    auto hashBytes = [&hash](const char *data, qsizetype size) {
+        for (qsizetype i = 0; i < size; i++) {
+            hash ^= (quint8)data[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    hashBytes(reinterpret_cast<const char *>(&this->width), sizeof(this->width));
+    hashBytes(reinterpret_cast<const char *>(&this->height), sizeof(this->height));
+    hashBytes(this->indices.constData(), this->indices.size());
+    hashBytes(this->mask.constData(), this->mask.size());
+    return hash;
+}
+
+// (re)allocates the pixel planes and makes every pixel transparent
+void D1GfxFrame::resize(int w, int h)
+{
+    this->width = w;
+    this->height = h;
+    this->maskStride = (w + 7) / 8;
+    this->revision = 0;
+    this->indices.fill(0, w * h);
+    this->mask.fill((char)0xFF, this->maskStride * h);
+}
+
+void D1GfxFrame::setPixel(int x, int y, quint8 color)
+{
+    this->indices.data()[y * this->width + x] = color;
+    this->mask.data()[y * this->maskStride + (x >> 3)] &= ~(1 << (x & 7));
+}
+
+// copies the opaque pixels of src to the given position (clipped to the frame)
+void D1GfxFrame::drawFrame(int x, int y, const D1GfxFrame &src)
+{
+    const int sx0 = std::max(0, -x);
+    const int sx1 = std::min(src.width, this->width - x);
+    if (sx0 >= sx1)
+        return;
+
+    quint8 *dstIndices = reinterpret_cast<quint8 *>(this->indices.data());
+    quint8 *dstMask = reinterpret_cast<quint8 *>(this->mask.data());
+    for (int sy = std::max(0, -y); sy < src.height && sy + y < this->height; sy++) {
+        const quint8 *srcIndexRow = src.getIndexRow(sy);
+        const quint8 *srcMaskRow = src.getMaskRow(sy);
+        quint8 *dstIndexRow = &dstIndices[(sy + y) * this->width + x];
+        quint8 *dstMaskRow = &dstMask[(sy + y) * this->maskStride];
+        for (int sx = sx0; sx < sx1;) {
+            if (src.isTransparent(sx, sy)) {
+                sx += D1RowScanner::transparentRunLength(srcMaskRow, sx, sx1);
+                continue;
+            }
+            const int runWidth = D1RowScanner::opaqueRunLength(srcMaskRow, sx, sx1);
+            memcpy(&dstIndexRow[sx], &srcIndexRow[sx], runWidth);
+            for (int dx = x + sx; dx < x + sx + runWidth; dx++)
+                dstMaskRow[dx >> 3] &= ~(1 << (dx & 7));
+            sx += runWidth;
+        }
+    }
+}
+
 D1CEL_FRAME_TYPE D1GfxFrame::getFrameType() const
 {
     return this->frameType;
@@ -96,38 +225,176 @@ QImage D1Gfx::getFrameImage(quint16 frameIndex)
     if (frameIndex >= this->frames.count())
         return EmptyFramePlaceholder("Out of bounds");
 
-    D1GfxFrame &frame = this->frames[frameIndex];
+    D1GfxFrame &frame = *this->getFrame(frameIndex);
 
     if (frame.getWidth() == 0 || frame.getHeight() == 0)
         return EmptyFramePlaceholder("No frame data");
 
+    return this->renderFrameImage(frame);
+}
+
+QImage D1Gfx::renderFrameImage(const D1GfxFrame &frame)
+{
+    if (this->palette == nullptr)
+        return EmptyFramePlaceholder("No palette");
+
     QImage image = QImage(
         frame.getWidth(),
         frame.getHeight(),
         QImage::Format_ARGB32);
 
+    const QRgb *colors = this->palette->getRgbColors();
+    const int width = frame.getWidth();
     for (int y = 0; y < frame.getHeight(); y++) {
-        for (int x = 0; x < frame.getWidth(); x++) {
-            D1GfxPixel d1pix = frame.getPixel(x, y);
+        const quint8 *indexRow = frame.getIndexRow(y);
+        const quint8 *maskRow = frame.getMaskRow(y);
+        QRgb *destRow = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width;) {
+            if (frame.isTransparent(x, y)) {
+                const int runWidth = D1RowScanner::transparentRunLength(maskRow, x, width);
+                std::fill_n(&destRow[x], runWidth, qRgba(0, 0, 0, 0));
+                x += runWidth;
+            } else {
+                const int end = x + D1RowScanner::opaqueRunLength(maskRow, x, width);
+                for (; x < end; x++)
+                    destRow[x] = colors[indexRow[x]];
+            }
+        }
+    }
+
+    return image;
+}
 
-            QColor color;
-            if (d1pix.isTransparent())
-                color = QColor(Qt::transparent);
-            else
-                color = this->palette->getColor(d1pix.getPaletteIndex());
+QImage D1Gfx::getFrameIndexedImage(quint16 frameIndex)
+{
+    if (this->palette == nullptr)
+        return EmptyFramePlaceholder("No palette");
+
+    if (frameIndex >= this->frames.count())
+        return EmptyFramePlaceholder("Out of bounds");
 
-            image.setPixel(x, y, color.rgba());
+    D1GfxFrame &frame = *this->getFrame(frameIndex);
+
+    if (frame.getWidth() == 0 || frame.getHeight() == 0)
+        return EmptyFramePlaceholder("No frame data");
+
+    if (this->frameImageCacheLimit <= 0)
+        return this->renderFrameIndexedImage(frame);
+
+    this->getFrameRevision(frameIndex);
+
+    auto it = this->frameImageCache.find(frameIndex);
+    if (it != this->frameImageCache.end()) {
+        D1GfxFrameImage &entry = it.value();
+        if (entry.revision == frame.revision) {
+            // only the colors changed: the indices of the image are still valid
+            if ((entry.palette == this->palette && entry.paletteGeneration == this->palette->getGeneration())
+                || this->updateColorTable(entry.image)) {
+                this->frameImageCacheHits++;
+                entry.palette = this->palette;
+                entry.paletteGeneration = this->palette->getGeneration();
+                entry.lastUse = ++this->frameImageUseCounter;
+                return entry.image;
+            }
         }
+        this->frameImageCacheSize -= entry.image.sizeInBytes();
+        this->frameImageCache.erase(it);
     }
 
+    this->frameImageCacheMisses++;
+    QImage image = this->renderFrameIndexedImage(frame);
+    this->frameImageCache.insert(frameIndex, D1GfxFrameImage { frame.revision, this->palette, this->palette->getGeneration(), image, ++this->frameImageUseCounter });
+    this->frameImageCacheSize += image.sizeInBytes();
+    this->evictFrameImages();
     return image;
 }
 
+QImage D1Gfx::renderFrameIndexedImage(const D1GfxFrame &frame)
+{
+    if (this->palette == nullptr)
+        return EmptyFramePlaceholder("No palette");
+
+    // find a palette index which is not used by the opaque pixels to represent the transparent ones
+    const int width = frame.getWidth();
+    bool hasTransparentPixels = false;
+    bool usedIndices[D1PAL_COLORS] = {};
+    for (int y = 0; y < frame.getHeight(); y++) {
+        const quint8 *indexRow = frame.getIndexRow(y);
+        const quint8 *maskRow = frame.getMaskRow(y);
+        for (int x = 0; x < width;) {
+            if (frame.isTransparent(x, y)) {
+                hasTransparentPixels = true;
+                x += D1RowScanner::transparentRunLength(maskRow, x, width);
+            } else {
+                const int end = x + D1RowScanner::opaqueRunLength(maskRow, x, width);
+                for (; x < end; x++)
+                    usedIndices[indexRow[x]] = true;
+            }
+        }
+    }
+    int transparentIndex = -1;
+    if (hasTransparentPixels) {
+        transparentIndex = std::find(std::begin(usedIndices), std::end(usedIndices), false) - std::begin(usedIndices);
+        if (transparentIndex == D1PAL_COLORS)
+            return this->renderFrameImage(frame);
+    }
+
+    QImage image = QImage(width, frame.getHeight(), QImage::Format_Indexed8);
+
+    const QRgb *colors = this->palette->getRgbColors();
+    QVector<QRgb> colorTable(colors, colors + D1PAL_COLORS);
+    if (transparentIndex >= 0)
+        colorTable[transparentIndex] = qRgba(0, 0, 0, 0);
+    image.setColorTable(colorTable);
+
+    for (int y = 0; y < frame.getHeight(); y++) {
+        const quint8 *indexRow = frame.getIndexRow(y);
+        uchar *destRow = image.scanLine(y);
+        // the transparent pixels are stored with index 0
+        memcpy(destRow, indexRow, width);
+        if (transparentIndex <= 0 || frame.isRowOpaque(y))
+            continue;
+        const quint8 *maskRow = frame.getMaskRow(y);
+        for (int x = 0; x < width;) {
+            if (frame.isTransparent(x, y)) {
+                const int runWidth = D1RowScanner::transparentRunLength(maskRow, x, width);
+                memset(&destRow[x], transparentIndex, runWidth);
+                x += runWidth;
+            } else {
+                x += D1RowScanner::opaqueRunLength(maskRow, x, width);
+            }
+        }
+    }
+
+    return image;
+}
+
+bool D1Gfx::updateColorTable(QImage &image)
+{
+    if (this->palette == nullptr || image.format() != QImage::Format_Indexed8)
+        return false;
+
+    QVector<QRgb> colorTable = image.colorTable();
+    if (colorTable.size() != D1PAL_COLORS)
+        return false;
+
+    const QRgb *colors = this->palette->getRgbColors();
+    for (int i = 0; i < D1PAL_COLORS; i++) {
+        // keep the entry of the transparent pixels
+        if (qAlpha(colorTable[i]) != 0)
+            colorTable[i] = colors[i];
+    }
+    image.setColorTable(colorTable);
+    return true;
+}
+
 void D1Gfx::insertGroup(int groupIdx, int frameIdx, const QImage &image)
 {
     D1GfxFrame frame;
     D1ImageFrame::load(frame, image, this->palette);
     this->frames.insert(frameIdx, frame);
+    this->relinkDecodedFrames(D1Remap::shiftedIndices(this->frames.count() - 1, frameIdx, 1));
+    this->clearFrameImageCache();
     this->groupFrameIndices.insert(groupIdx, QPair<int, int>(frameIdx, frameIdx));
 
     // We have to increment first frame index in the group that follows the one that we have deleted,
@@ -143,6 +410,8 @@ D1GfxFrame *D1Gfx::insertFrame(int frameIdx, const QImage &image)
     D1GfxFrame frame;
     D1ImageFrame::load(frame, image, this->palette);
     this->frames.insert(frameIdx, frame);
+    this->relinkDecodedFrames(D1Remap::shiftedIndices(this->frames.count() - 1, frameIdx, 1));
+    this->clearFrameImageCache();
 
     if (this->groupFrameIndices.isEmpty()) {
         // create new group if this is the first frame
@@ -171,6 +440,8 @@ void D1Gfx::insertFrameInGroup(int frameIdx, int groupIdx, const QImage &image)
     D1GfxFrame frame;
     D1ImageFrame::load(frame, image, this->palette);
     this->frames.insert(frameIdx, frame);
+    this->relinkDecodedFrames(D1Remap::shiftedIndices(this->frames.count() - 1, frameIdx, 1));
+    this->clearFrameImageCache();
 
     this->groupFrameIndices[groupIdx].second++;
 
@@ -187,7 +458,11 @@ D1GfxFrame *D1Gfx::replaceFrame(int idx, const QImage &image)
 {
     D1GfxFrame frame;
     D1ImageFrame::load(frame, image, this->palette);
+    if (this->isDecodedFrameLinked(idx))
+        this->unlinkDecodedFrame(idx);
     this->frames[idx] = frame;
+    this->frameImageCacheSize -= this->frameImageCache.value(idx).image.sizeInBytes();
+    this->frameImageCache.remove(idx);
 
     this->modified = true;
     return &this->frames[idx];
@@ -195,7 +470,12 @@ D1GfxFrame *D1Gfx::replaceFrame(int idx, const QImage &image)
 
 std::optional<int> D1Gfx::removeFrame(quint16 idx)
 {
+    if (this->isDecodedFrameLinked(idx))
+        this->unlinkDecodedFrame(idx);
     this->frames.removeAt(idx);
+    this->relinkDecodedFrames(D1Remap::shiftedIndices(this->frames.count() + 1, idx, -1));
+    // the indices of the following frames changed
+    this->clearFrameImageCache();
     std::optional<int> removedGroupIdx;
 
     for (int i = 0; i < this->groupFrameIndices.count(); i++) {
@@ -230,14 +510,24 @@ void D1Gfx::regroupFrames(int numGroups)
     this->modified = true;
 }
 
-void D1Gfx::remapFrames(const QMap<unsigned, unsigned> &remap)
+void D1Gfx::remapFrames(const D1IndexRemap &remap)
 {
-    QList<D1GfxFrame> newFrames;
     // assert(this->groupFrameIndices.count() == 1);
-    for (auto iter = remap.cbegin(); iter != remap.cend(); ++iter) {
-        newFrames.append(this->frames.at(iter.value() - 1));
+    const D1IndexRemap fullRemap = D1Remap::completeRemap(remap, this->frames.count());
+    for (int i = 0; i < this->frames.count(); i++) {
+        if (fullRemap[i] < 0 && this->isDecodedFrameLinked(i))
+            this->unlinkDecodedFrame(i);
     }
-    this->frames.swap(newFrames);
+    D1Remap::moveEntries(this->frames, fullRemap);
+    this->relinkDecodedFrames(fullRemap);
+    // keep the group of the tileset-frames in sync
+    if (this->groupFrameIndices.count() == 1) {
+        if (this->frames.isEmpty())
+            this->groupFrameIndices.clear();
+        else
+            this->groupFrameIndices[0] = qMakePair(0, this->frames.count() - 1);
+    }
+    this->clearFrameImageCache();
     this->modified = true;
 }
 
@@ -299,12 +589,25 @@ int D1Gfx::getFrameCount()
     return this->frames.count();
 }
 
+// returns the frame of given index, lazily loaded frames are decoded on first access
+// the returned pointer is valid until the frames are modified or an other frame is decoded
 D1GfxFrame *D1Gfx::getFrame(int frameIndex)
 {
     if (frameIndex < 0 || frameIndex >= this->frames.count())
         return nullptr;
 
-    return &this->frames[frameIndex];
+    D1GfxFrame &frame = this->frames[frameIndex];
+    if (!frame.decoded) {
+        this->decodeFrame(frame, frameIndex);
+        if (!frame.indices.isEmpty())
+            this->linkDecodedFrame(frameIndex);
+        this->evictFrames();
+    } else if (this->isDecodedFrameLinked(frameIndex) && this->lruHead != frameIndex) {
+        // move to the front of the LRU list
+        this->unlinkDecodedFrame(frameIndex);
+        this->linkDecodedFrame(frameIndex);
+    }
+    return &frame;
 }
 
 int D1Gfx::getFrameWidth(int frameIndex)
@@ -312,7 +615,12 @@ int D1Gfx::getFrameWidth(int frameIndex)
     if (frameIndex < 0 || frameIndex >= this->frames.count())
         return 0;
 
-    return this->frames[frameIndex].getWidth();
+    // the size of an evicted frame is still known
+    const D1GfxFrame &frame = this->frames[frameIndex];
+    if (frame.decoded || frame.width != 0)
+        return frame.getWidth();
+
+    return this->getFrame(frameIndex)->getWidth();
 }
 
 int D1Gfx::getFrameHeight(int frameIndex)
@@ -320,5 +628,218 @@ int D1Gfx::getFrameHeight(int frameIndex)
     if (frameIndex < 0 || frameIndex >= this->frames.count())
         return 0;
 
-    return this->frames[frameIndex].getHeight();
+    const D1GfxFrame &frame = this->frames[frameIndex];
+    if (frame.decoded || frame.width != 0)
+        return frame.getHeight();
+
+    return this->getFrame(frameIndex)->getHeight();
+}
+
+// returns the revision of the frame's content (assigned on first use)
+quint64 D1Gfx::getFrameRevision(int frameIndex)
+{
+    if (frameIndex < 0 || frameIndex >= this->frames.count())
+        return 0;
+
+    D1GfxFrame &frame = this->frames[frameIndex];
+    if (frame.revision == 0)
+        frame.revision = ++this->frameRevisionCounter;
+    return frame.revision;
+}
+
+// decodes every pending frame in parallel (the memory limit is applied at the next on-demand decoding)
+void D1Gfx::decodeAllFrames()
+{
+    std::vector<int> pendingFrames;
+    for (int i = 0; i < this->frames.count(); i++) {
+        pendingFrames.push_back(i);
+    }
+    this->decodeFrames(pendingFrames);
+}
+
+// decodes the pending frames of the list in parallel (the memory limit is applied at the next on-demand decoding)
+void D1Gfx::decodeFrames(const std::vector<int> &frameIndices)
+{
+    // the list is detached here, so each worker writes only its own frame
+    std::vector<std::pair<D1GfxFrame *, int>> jobs;
+    for (int frameIndex : frameIndices) {
+        if (frameIndex >= 0 && frameIndex < this->frames.count() && !this->frames[frameIndex].decoded)
+            jobs.push_back({ &this->frames[frameIndex], frameIndex });
+    }
+    if (jobs.empty())
+        return;
+
+    QtConcurrent::blockingMap(jobs, [this](const std::pair<D1GfxFrame *, int> &job) {
+        this->decodeFrame(*job.first, job.second);
+    });
+    for (const std::pair<D1GfxFrame *, int> &job : jobs) {
+        if (!job.first->indices.isEmpty())
+            this->linkDecodedFrame(job.second);
+    }
+}
+
+void D1Gfx::setDecodedFramesLimit(qint64 limit)
+{
+    this->decodedFramesLimit = limit;
+    this->evictFrames();
+}
+
+// keeps the encoded frames in memory if the source file is about to be replaced by filePath
+void D1Gfx::releaseEncodedFile(const QString &filePath)
+{
+#if defined(Q_OS_WIN)
+    // a mapped file can not be replaced on Windows (elsewhere the mapping keeps the content of the replaced file)
+    if (this->encodedFile != nullptr && this->encodedFile->isFile(filePath))
+        this->encodedFile->detach();
+#else
+    Q_UNUSED(filePath);
+#endif
+}
+
+void D1Gfx::clearFrames()
+{
+    this->frames.clear();
+    this->lruHead = -1;
+    this->lruTail = -1;
+    this->decodedFramesSize = 0;
+    this->clearFrameImageCache();
+}
+
+void D1Gfx::appendEncodedFrame(quint32 offset, quint32 size)
+{
+    D1GfxFrame frame;
+    frame.encoded = true;
+    frame.decoded = false;
+    frame.encodedOffset = offset;
+    frame.encodedSize = size;
+    this->frames.append(frame);
+}
+
+// thread-safe as long as the frames are not accessed otherwise
+void D1Gfx::decodeFrame(D1GfxFrame &frame, int frameIndex)
+{
+    D1GfxFrame decodedFrame;
+    const D1DataView rawData = this->encodedFile->view().mid(frame.encodedOffset, frame.encodedSize);
+    if (!this->frameDecoder(decodedFrame, rawData)) {
+        qDebug() << "Failed to load frame: " << frameIndex;
+        decodedFrame = {};
+    }
+    decodedFrame.encoded = true;
+    decodedFrame.encodedOffset = frame.encodedOffset;
+    decodedFrame.encodedSize = frame.encodedSize;
+    // the content did not change
+    decodedFrame.revision = frame.revision;
+    frame = decodedFrame;
+}
+
+bool D1Gfx::isDecodedFrameLinked(int frameIndex) const
+{
+    return this->lruHead == frameIndex || this->frames[frameIndex].lruPrev >= 0;
+}
+
+// puts a frame decoded from the source file at the front of the LRU list
+void D1Gfx::linkDecodedFrame(int frameIndex)
+{
+    D1GfxFrame &frame = this->frames[frameIndex];
+    frame.lruPrev = -1;
+    frame.lruNext = this->lruHead;
+    if (this->lruHead >= 0)
+        this->frames[this->lruHead].lruPrev = frameIndex;
+    else
+        this->lruTail = frameIndex;
+    this->lruHead = frameIndex;
+    this->decodedFramesSize += frame.indices.size() + frame.mask.size();
+}
+
+void D1Gfx::unlinkDecodedFrame(int frameIndex)
+{
+    D1GfxFrame &frame = this->frames[frameIndex];
+    if (frame.lruPrev >= 0)
+        this->frames[frame.lruPrev].lruNext = frame.lruNext;
+    else
+        this->lruHead = frame.lruNext;
+    if (frame.lruNext >= 0)
+        this->frames[frame.lruNext].lruPrev = frame.lruPrev;
+    else
+        this->lruTail = frame.lruPrev;
+    frame.lruPrev = -1;
+    frame.lruNext = -1;
+    this->decodedFramesSize -= frame.indices.size() + frame.mask.size();
+}
+
+// updates the LRU list after the frames are moved (the removed frames must be unlinked beforehand)
+void D1Gfx::relinkDecodedFrames(const D1IndexRemap &remap)
+{
+    int prevIndex = -1;
+    for (int oldIndex = this->lruHead; oldIndex >= 0;) {
+        const int frameIndex = remap[oldIndex];
+        D1GfxFrame &frame = this->frames[frameIndex];
+        oldIndex = frame.lruNext;
+        frame.lruPrev = prevIndex;
+        if (prevIndex >= 0)
+            this->frames[prevIndex].lruNext = frameIndex;
+        else
+            this->lruHead = frameIndex;
+        prevIndex = frameIndex;
+    }
+    if (prevIndex >= 0)
+        this->frames[prevIndex].lruNext = -1;
+    this->lruTail = prevIndex;
+}
+
+// drops the least recently used decoded frames which are not modified to respect the memory limit
+void D1Gfx::evictFrames()
+{
+    if (this->decodedFramesLimit <= 0)
+        return;
+
+    // the most recently used frame is always kept
+    while (this->decodedFramesSize > this->decodedFramesLimit && this->lruTail != this->lruHead) {
+        const int frameIndex = this->lruTail;
+        this->unlinkDecodedFrame(frameIndex);
+        D1GfxFrame &frame = this->frames[frameIndex];
+        frame.indices = QByteArray();
+        frame.mask = QByteArray();
+        frame.decoded = false;
+    }
+}
+
+void D1Gfx::setFrameImageCacheLimit(qint64 limit)
+{
+    this->frameImageCacheLimit = limit;
+    if (limit <= 0) {
+        this->clearFrameImageCache();
+    } else {
+        this->evictFrameImages();
+    }
+}
+
+quint64 D1Gfx::getFrameImageCacheHits() const
+{
+    return this->frameImageCacheHits;
+}
+
+quint64 D1Gfx::getFrameImageCacheMisses() const
+{
+    return this->frameImageCacheMisses;
+}
+
+void D1Gfx::clearFrameImageCache()
+{
+    this->frameImageCache.clear();
+    this->frameImageCacheSize = 0;
+}
+
+// drops the least recently used frame images to respect the memory limit
+void D1Gfx::evictFrameImages()
+{
+    while (this->frameImageCacheSize > this->frameImageCacheLimit && this->frameImageCache.count() > 1) {
+        auto oldest = this->frameImageCache.begin();
+        for (auto it = this->frameImageCache.begin(); it != this->frameImageCache.end(); ++it) {
+            if (it.value().lastUse < oldest.value().lastUse)
+                oldest = it;
+        }
+        this->frameImageCacheSize -= oldest.value().image.sizeInBytes();
+        this->frameImageCache.erase(oldest);
+    }
 }
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <QByteArray>
 #include <QImage>
 #include <QMap>
 #include <QtEndian>
 
+#include <functional>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "d1celtilesetframe.h"
+#include "d1dataview.h"
+#include "d1remap.h"
 #include "palette/d1pal.h"
 
 // TODO: move these to some persistency class?
@@ -35,7 +41,11 @@ private:
     quint8 paletteIndex = 0;
 };
 
+// Pixels of a frame are stored in two contiguous planes:
+//  - the palette indices, one byte per pixel (transparent pixels hold 0)
+//  - the transparency mask, one bit per pixel (set if the pixel is transparent), rows padded to full bytes
 class D1GfxFrame {
+    friend class D1Gfx;
     friend class D1Cel;
     friend class D1CelFrame;
     friend class D1Cl2;
@@ -43,6 +53,8 @@ class D1GfxFrame {
     friend class D1CelTileset;
     friend class D1CelTilesetFrame;
     friend class D1ImageFrame;
+    friend class D1Min;
+    friend class D1Til;
 
 public:
     D1GfxFrame() = default;
@@ -51,15 +63,50 @@ public:
     int getWidth() const;
     int getHeight() const;
     D1GfxPixel getPixel(int x, int y) const;
+    // unchecked accessors, the coordinates must be inside the frame
+    bool isTransparent(int x, int y) const;
+    quint8 getPaletteIndex(int x, int y) const;
+    const quint8 *getIndexRow(int y) const;
+    const quint8 *getMaskRow(int y) const;
+    int getMaskStride() const;
+    bool isRowOpaque(int y) const;
+    bool isRowTransparent(int y) const;
+    bool pixelsEqual(const D1GfxFrame &other) const;
+    quint64 getContentHash() const;
     D1CEL_FRAME_TYPE getFrameType() const;
     void setFrameType(D1CEL_FRAME_TYPE type);
 
 protected:
+    void resize(int width, int height);
+    void setPixel(int x, int y, quint8 color);
+    void drawFrame(int x, int y, const D1GfxFrame &src);
+
     int width = 0;
     int height = 0;
-    QList<QList<D1GfxPixel>> pixels;
+    int maskStride = 0;
+    QByteArray indices;
+    QByteArray mask;
     // fields of tileset-frames
     D1CEL_FRAME_TYPE frameType = D1CEL_FRAME_TYPE::TransparentSquare;
+    // fields of lazily loaded frames
+    bool encoded = false; // the frame can be (re)decoded from the source file
+    bool decoded = true;
+    quint32 encodedOffset = 0;
+    quint32 encodedSize = 0;
+    // links of the evictable frames in D1Gfx (most recently used first, -1 at the ends)
+    int lruPrev = -1;
+    int lruNext = -1;
+    // identifies the content of the frame (0 if not assigned yet, reset if the frame is resized)
+    quint64 revision = 0;
+};
+
+// Indexed image of a frame in the image cache of D1Gfx
+struct D1GfxFrameImage {
+    quint64 revision;
+    D1Pal *palette;
+    quint64 paletteGeneration;
+    QImage image;
+    quint64 lastUse;
 };
 
 class D1Gfx : public QObject {
@@ -74,12 +121,19 @@ public:
     ~D1Gfx() = default;
 
     QImage getFrameImage(quint16 frameIndex);
+    // Indexed8 image of the frame (ARGB32 if every palette index is used and there is no index left for the transparent pixels)
+    QImage getFrameIndexedImage(quint16 frameIndex);
+    // replace the color table of an Indexed8 image with the current colors of the palette
+    bool updateColorTable(QImage &image);
+    // convert a (composed) frame to an image with the current palette
+    QImage renderFrameImage(const D1GfxFrame &frame);
+    QImage renderFrameIndexedImage(const D1GfxFrame &frame);
     D1GfxFrame *insertFrame(int frameIdx, const QImage &image);
     void insertFrameInGroup(int frameIdx, int groupIdx, const QImage &image);
     D1GfxFrame *replaceFrame(int frameIndex, const QImage &image);
     std::optional<int> removeFrame(quint16 frameIndex);
     void regroupFrames(int count);
-    void remapFrames(const QMap<unsigned, unsigned> &remap);
+    void remapFrames(const D1IndexRemap &remap);
 
     bool isModified() const;
     void setModified(bool isModified);
@@ -96,8 +150,27 @@ public:
     D1GfxFrame *getFrame(int frameIndex);
     int getFrameWidth(int frameIndex);
     int getFrameHeight(int frameIndex);
+    quint64 getFrameRevision(int frameIndex);
+    void decodeAllFrames();
+    void decodeFrames(const std::vector<int> &frameIndices);
+    void setDecodedFramesLimit(qint64 limit);
+    void releaseEncodedFile(const QString &filePath);
+    void setFrameImageCacheLimit(qint64 limit);
+    quint64 getFrameImageCacheHits() const;
+    quint64 getFrameImageCacheMisses() const;
 
 protected:
+    void clearFrames();
+    void appendEncodedFrame(quint32 offset, quint32 size);
+    void decodeFrame(D1GfxFrame &frame, int frameIndex);
+    bool isDecodedFrameLinked(int frameIndex) const;
+    void linkDecodedFrame(int frameIndex);
+    void unlinkDecodedFrame(int frameIndex);
+    void relinkDecodedFrames(const D1IndexRemap &remap);
+    void evictFrames();
+    void clearFrameImageCache();
+    void evictFrameImages();
+
     bool modified = false;
     bool isTileset_ = false;
     bool hasHeader_ = true;
@@ -105,4 +178,20 @@ protected:
     D1Pal *palette = nullptr;
     QList<QPair<quint16, quint16>> groupFrameIndices;
     QList<D1GfxFrame> frames;
+    // source of the lazily loaded frames
+    std::unique_ptr<D1FileData> encodedFile;
+    std::function<bool(D1GfxFrame &frame, const D1DataView &rawData)> frameDecoder;
+    qint64 decodedFramesLimit = 0; // in bytes, 0 means unlimited
+    // LRU list of the decoded frames which can be evicted and their total size
+    int lruHead = -1;
+    int lruTail = -1;
+    qint64 decodedFramesSize = 0;
+    // cache of the indexed images requested by the views (keyed by the frame index)
+    QMap<int, D1GfxFrameImage> frameImageCache;
+    qint64 frameImageCacheSize = 0;
+    qint64 frameImageCacheLimit = 0; // in bytes, 0 means disabled
+    quint64 frameImageUseCounter = 0;
+    quint64 frameRevisionCounter = 0;
+    quint64 frameImageCacheHits = 0;
+    quint64 frameImageCacheMisses = 0;
 };
@@ -1,53 +1,143 @@
 #include "d1image.h"
 
 #include <climits>
+#include <cstring>
+#include <vector>
 
 #include <QColor>
+#include <QHash>
 #include <QImage>
-#include <QList>
+#include <QtConcurrent>
 
-static quint8 getPalColor(D1Pal *pal, QColor color)
+// number of rows converted by a worker at once
+#define IMAGE_ROW_BLOCK 16
+// number of cached color matches after which the cache is restarted
+#define PAL_COLOR_CACHE_LIMIT (1 << 20)
+
+namespace {
+
+// Nearest palette colors of the previously imported colors
+struct PalColorCache {
+    QRgb colors[D1PAL_COLORS];
+    bool defaultPalette = false;
+    bool valid = false;
+    int candidates[D1PAL_COLORS];
+    int numCandidates = 0;
+    QHash<QRgb, quint8> matches;
+};
+
+// only used from the GUI thread, the workers read it while it is not modified
+PalColorCache palColorCache;
+
+void preparePalColorCache(D1Pal *pal)
 {
-    int res = 0;
-    int best = INT_MAX;
+    const QRgb *colors = pal->getRgbColors();
+    bool defaultPalette = pal->getFilePath() == D1Pal::DEFAULT_PATH;
+    PalColorCache &cache = palColorCache;
+    if (cache.valid && cache.defaultPalette == defaultPalette && memcmp(cache.colors, colors, sizeof(cache.colors)) == 0)
+        return;
 
+    memcpy(cache.colors, colors, sizeof(cache.colors));
+    cache.defaultPalette = defaultPalette;
+    cache.valid = true;
+    cache.numCandidates = 0;
     for (int i = 0; i < D1PAL_COLORS; i++) {
-        if (i == 1 && pal->getFilePath() == D1Pal::DEFAULT_PATH) {
+        if (i == 1 && defaultPalette) {
             i = 128; // skip indices between 1 and 127 from the default palette
         }
-        QColor palColor = pal->getColor(i);
-        int currR = color.red() - palColor.red();
-        int currG = color.green() - palColor.green();
-        int currB = color.blue() - palColor.blue();
+        cache.candidates[cache.numCandidates++] = i;
+    }
+    cache.matches.clear();
+}
+
+quint8 getPalColor(const PalColorCache &cache, QRgb color)
+{
+    int res = 0;
+    int best = INT_MAX;
+
+    for (int n = 0; n < cache.numCandidates; n++) {
+        int i = cache.candidates[n];
+        QRgb palColor = cache.colors[i];
+        int currR = qRed(color) - qRed(palColor);
+        int currG = qGreen(color) - qGreen(palColor);
+        int currB = qBlue(color) - qBlue(palColor);
         int curr = currR * currR + currG * currG + currB * currB;
         if (curr < best) {
             best = curr;
             res = i;
+            if (curr == 0)
+                break;
         }
     }
 
     return res;
 }
 
+} // namespace
+
 bool D1ImageFrame::load(D1GfxFrame &frame, const QImage &image, D1Pal *pal)
 {
-    frame.width = image.width();
-    frame.height = image.height();
-
-    frame.pixels.clear();
-
-    for (int y = 0; y < frame.height; y++) {
-        QList<D1GfxPixel> pixelLine;
-        for (int x = 0; x < frame.width; x++) {
-            QColor color = image.pixelColor(x, y);
-            // if (color == QColor(Qt::transparent)) {
-            if (color.alpha() < COLOR_ALPHA_LIMIT) {
-                pixelLine.append(D1GfxPixel::transparentPixel());
-            } else {
-                pixelLine.append(D1GfxPixel::colorPixel(getPalColor(pal, color)));
+    frame.resize(image.width(), image.height());
+
+    const QImage srcImage = image.convertToFormat(QImage::Format_ARGB32);
+    preparePalColorCache(pal);
+    const PalColorCache &cache = palColorCache;
+
+    // the rows are converted in parallel, the new matches are collected per block and added to the cache afterwards
+    const int numBlocks = (frame.height + IMAGE_ROW_BLOCK - 1) / IMAGE_ROW_BLOCK;
+    std::vector<int> blocks(numBlocks);
+    std::vector<QHash<QRgb, quint8>> blockMatches(numBlocks);
+    for (int i = 0; i < numBlocks; i++) {
+        blocks[i] = i;
+    }
+    // each worker writes only its own rows (the mask rows are padded to full bytes)
+    quint8 *indices = reinterpret_cast<quint8 *>(frame.indices.data());
+    quint8 *mask = reinterpret_cast<quint8 *>(frame.mask.data());
+    const int width = frame.width;
+    const int height = frame.height;
+    const int maskStride = frame.maskStride;
+    QtConcurrent::blockingMap(blocks, [&](int block) {
+        QHash<QRgb, quint8> &newMatches = blockMatches[block];
+        QRgb lastColor = 0;
+        quint8 lastIndex = 0;
+        bool hasLast = false;
+        for (int y = block * IMAGE_ROW_BLOCK; y < height && y < (block + 1) * IMAGE_ROW_BLOCK; y++) {
+            const QRgb *srcRow = reinterpret_cast<const QRgb *>(srcImage.constScanLine(y));
+            quint8 *indexRow = &indices[y * width];
+            quint8 *maskRow = &mask[y * maskStride];
+            for (int x = 0; x < width; x++) {
+                QRgb color = srcRow[x];
+                if (qAlpha(color) < COLOR_ALPHA_LIMIT)
+                    continue;
+                color |= 0xFF000000;
+                if (!hasLast || color != lastColor) {
+                    auto it = cache.matches.constFind(color);
+                    if (it != cache.matches.constEnd()) {
+                        lastIndex = it.value();
+                    } else {
+                        auto nit = newMatches.constFind(color);
+                        if (nit != newMatches.constEnd()) {
+                            lastIndex = nit.value();
+                        } else {
+                            lastIndex = getPalColor(cache, color);
+                            newMatches.insert(color, lastIndex);
+                        }
+                    }
+                    lastColor = color;
+                    hasLast = true;
+                }
+                indexRow[x] = lastIndex;
+                maskRow[x >> 3] &= ~(1 << (x & 7));
             }
         }
-        frame.pixels.append(pixelLine);
+    });
+
+    if (palColorCache.matches.size() > PAL_COLOR_CACHE_LIMIT)
+        palColorCache.matches.clear();
+    for (const QHash<QRgb, quint8> &newMatches : blockMatches) {
+        for (auto it = newMatches.constBegin(); it != newMatches.constEnd(); ++it) {
+            palColorCache.matches.insert(it.key(), it.value());
+        }
     }
 
     return true;
@@ -1,38 +1,32 @@
 #include "d1min.h"
 
-#include <QBuffer>
+#include <algorithm>
+
 #include <QDebug>
 #include <QFile>
-#include <QFileInfo>
 #include <QMessageBox>
-#include <QPainter>
+#include <QtEndian>
 
+#include "d1dataview.h"
 #include "d1image.h"
 
 bool D1Min::load(QString filePath, D1Gfx *g, D1Sol *sol, std::map<unsigned, D1CEL_FRAME_TYPE> &celFrameTypes, const OpenAsParam &params)
 {
-    // prepare file data source
-    QFile file;
+    // prepare file data source (memory-mapped)
+    D1FileData file;
     // done by the caller
     // if (!params.minFilePath.isEmpty()) {
     //    filePath = params.minFilePath;
     // }
     if (!filePath.isEmpty()) {
-        file.setFileName(filePath);
-        if (!file.open(QIODevice::ReadOnly)) {
+        if (!file.open(filePath)) {
             return false;
         }
     }
-
-    QByteArray fileData = file.readAll();
-    QBuffer fileBuffer(&fileData);
-
-    if (!fileBuffer.open(QIODevice::ReadOnly)) {
-        return false;
-    }
+    const D1DataView in = file.view();
 
     // calculate subtileWidth/Height
-    auto fileSize = file.size();
+    auto fileSize = in.size();
     int subtileCount = sol->getSubtileCount();
     int width = params.minWidth;
     if (width == 0) {
@@ -68,30 +62,20 @@ bool D1Min::load(QString filePath, D1Gfx *g, D1Sol *sol, std::map<unsigned, D1CE
         }
     }
 
-    // prepare an empty list with zeros
-    this->celFrameIndices.clear();
-    for (int i = 0; i < subtileCount; i++) {
-        QList<quint16> celFrameIndicesList;
-        for (int j = 0; j < subtileNumberOfCelFrames; j++) {
-            celFrameIndicesList.append(0);
-        }
-        this->celFrameIndices.append(celFrameIndicesList);
+    // Read MIN binary data in one go (the missing subtiles are zero)
+    this->celFrameIndices.assign((size_t)subtileCount * subtileNumberOfCelFrames, 0);
+    const int minEntryCount = minSubtileCount * subtileNumberOfCelFrames;
+    if (minEntryCount != 0) {
+        qFromLittleEndian<quint16>(in.data(), minEntryCount, this->celFrameIndices.data());
     }
-
-    // Read MIN binary data
-    QDataStream in(&fileBuffer);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    for (int i = 0; i < minSubtileCount; i++) {
-        QList<quint16> &celFrameIndicesList = this->celFrameIndices[i];
-        for (int j = 0; j < subtileNumberOfCelFrames; j++) {
-            quint16 readWord;
-            in >> readWord;
-            quint16 id = readWord & 0x0FFF;
-            celFrameIndicesList[j] = id;
-            celFrameTypes[id] = static_cast<D1CEL_FRAME_TYPE>((readWord & 0x7000) >> 12);
-        }
+    // split the frame types from the references
+    for (int i = 0; i < minEntryCount; i++) {
+        quint16 readWord = this->celFrameIndices[i];
+        quint16 id = readWord & 0x0FFF;
+        this->celFrameIndices[i] = id;
+        celFrameTypes[id] = static_cast<D1CEL_FRAME_TYPE>((readWord & 0x7000) >> 12);
     }
+    this->invalidateSubtiles();
 
     this->minFilePath = filePath;
     this->modified = false;
@@ -112,18 +96,16 @@ bool D1Min::save(const QString &gfxPath)
     }
 
     // write to file
-    QDataStream out(&outFile);
-    out.setByteOrder(QDataStream::LittleEndian);
-    for (int i = 0; i < this->celFrameIndices.size(); i++) {
-        QList<quint16> &celFrameIndicesList = this->celFrameIndices[i];
-        for (int j = 0; j < celFrameIndicesList.count(); j++) {
-            quint16 writeWord = celFrameIndicesList[j];
-            if (writeWord != 0) {
-                writeWord |= ((quint16)this->gfx->getFrame(writeWord - 1)->getFrameType()) << 12;
-            }
-            out << writeWord;
+    std::vector<quint16> outData(this->celFrameIndices.size());
+    for (size_t i = 0; i < outData.size(); i++) {
+        quint16 writeWord = this->celFrameIndices[i];
+        if (writeWord != 0) {
+            writeWord |= ((quint16)this->gfx->getFrame(writeWord - 1)->getFrameType()) << 12;
         }
+        outData[i] = writeWord;
     }
+    qToLittleEndian<quint16>(outData.data(), outData.size(), outData.data());
+    outFile.write(reinterpret_cast<const char *>(outData.data()), outData.size() * sizeof(quint16));
 
     this->minFilePath = filePath;
     this->modified = false;
@@ -133,23 +115,62 @@ bool D1Min::save(const QString &gfxPath)
 
 QImage D1Min::getSubtileImage(int subtileIndex)
 {
-    if (subtileIndex < 0 || subtileIndex >= this->celFrameIndices.size())
+    const D1GfxFrame *subtile = this->getSubtileFrame(subtileIndex);
+    if (subtile == nullptr)
         return QImage();
 
-    unsigned subtileWidthPx = this->subtileWidth * MICRO_WIDTH;
-    QImage subtile = QImage(subtileWidthPx,
-        this->subtileHeight * MICRO_HEIGHT, QImage::Format_ARGB32);
-    subtile.fill(Qt::transparent);
-    QPainter subtilePainter(&subtile);
+    return this->gfx->renderFrameImage(*subtile);
+}
 
-    unsigned dx = 0, dy = 0;
-    int n = this->subtileWidth * this->subtileHeight;
-    for (int i = 0; i < n; i++) {
-        quint16 celFrameIndex = this->celFrameIndices.at(subtileIndex).at(i);
+QImage D1Min::getSubtileIndexedImage(int subtileIndex)
+{
+    const D1GfxFrame *subtile = this->getSubtileFrame(subtileIndex);
+    if (subtile == nullptr)
+        return QImage();
 
-        if (celFrameIndex > 0)
-            subtilePainter.drawImage(dx, dy,
-                this->gfx->getFrameImage(celFrameIndex - 1));
+    return this->gfx->renderFrameIndexedImage(*subtile);
+}
+
+// returns the subtile composed in palette-index space (the pointer is valid until the cache is invalidated)
+const D1GfxFrame *D1Min::getSubtileFrame(int subtileIndex)
+{
+    if (subtileIndex < 0 || subtileIndex >= this->getSubtileCount())
+        return nullptr;
+
+    const D1EntryView celFrameIndicesList = this->getCelFrameIndices(subtileIndex);
+    QList<quint64> frameRevisions;
+    for (quint16 celFrameIndex : celFrameIndicesList) {
+        frameRevisions.append(celFrameIndex > 0 ? this->gfx->getFrameRevision(celFrameIndex - 1) : 0);
+    }
+
+    // the entries are checked against the current content in case the MIN or the frames were edited directly
+    auto it = this->subtileFrames.find(subtileIndex);
+    if (it != this->subtileFrames.end() && std::equal(it.value().celFrameIndices.cbegin(), it.value().celFrameIndices.cend(), celFrameIndicesList.begin(), celFrameIndicesList.end()) && it.value().frameRevisions == frameRevisions)
+        return &it.value().frame;
+
+    D1MinSubtileFrame &entry = this->subtileFrames[subtileIndex];
+    entry.celFrameIndices.assign(celFrameIndicesList.begin(), celFrameIndicesList.end());
+    entry.frameRevisions = frameRevisions;
+    entry.frame.resize(this->subtileWidth * MICRO_WIDTH, this->subtileHeight * MICRO_HEIGHT);
+    this->drawSubtile(entry.frame, 0, 0, subtileIndex);
+    entry.frame.revision = ++this->subtileRevisionCounter;
+    return &entry.frame;
+}
+
+// composes the subtile in palette-index space
+void D1Min::drawSubtile(D1GfxFrame &dst, int x, int y, int subtileIndex)
+{
+    if (subtileIndex < 0 || subtileIndex >= this->getSubtileCount())
+        return;
+
+    unsigned subtileWidthPx = this->subtileWidth * MICRO_WIDTH;
+    unsigned dx = 0, dy = 0;
+    for (quint16 celFrameIndex : this->getCelFrameIndices(subtileIndex)) {
+        if (celFrameIndex > 0) {
+            D1GfxFrame *frame = this->gfx->getFrame(celFrameIndex - 1);
+            if (frame != nullptr)
+                dst.drawFrame(x + dx, y + dy, *frame);
+        }
 
         dx += MICRO_WIDTH;
         if (dx == subtileWidthPx) {
@@ -157,9 +178,54 @@ QImage D1Min::getSubtileImage(int subtileIndex)
             dy += MICRO_HEIGHT;
         }
     }
+}
+
+// rebuild the frame -> subtiles index after a structural change
+void D1Min::updateFrameUsers()
+{
+    if (this->frameUsersUpToDate)
+        return;
 
-    subtilePainter.end();
-    return subtile;
+    this->frameUsers.clear();
+    for (int i = 0; i < this->getSubtileCount(); i++) {
+        for (quint16 celFrameIndex : this->getCelFrameIndices(i)) {
+            if (celFrameIndex == 0)
+                continue;
+            QList<int> &users = this->frameUsers[celFrameIndex - 1];
+            if (users.isEmpty() || users.last() != i)
+                users.append(i);
+        }
+    }
+    this->frameUsersUpToDate = true;
+}
+
+// returns the (ascending) indices of the subtiles which use the frame
+QList<int> D1Min::getFrameUsers(int frameIndex)
+{
+    this->updateFrameUsers();
+    return this->frameUsers.value(frameIndex);
+}
+
+QList<int> D1Min::invalidateFrame(int frameIndex)
+{
+    QList<int> users = this->getFrameUsers(frameIndex);
+    for (int subtileIndex : users) {
+        this->subtileFrames.remove(subtileIndex);
+    }
+    return users;
+}
+
+// the MIN-entry of the subtile changed
+void D1Min::invalidateSubtile(int subtileIndex)
+{
+    this->subtileFrames.remove(subtileIndex);
+    this->frameUsersUpToDate = false;
+}
+
+void D1Min::invalidateSubtiles()
+{
+    this->subtileFrames.clear();
+    this->frameUsersUpToDate = false;
 }
 
 bool D1Min::isModified() const
@@ -174,7 +240,8 @@ QString D1Min::getFilePath()
 
 int D1Min::getSubtileCount()
 {
-    return this->celFrameIndices.count();
+    const int n = this->subtileWidth * this->subtileHeight;
+    return n != 0 ? (int)(this->celFrameIndices.size() / n) : 0;
 }
 
 quint16 D1Min::getSubtileWidth()
@@ -194,28 +261,16 @@ void D1Min::setSubtileHeight(int height)
     }
     int width = this->subtileWidth;
     int diff = height - this->subtileHeight;
-    if (diff > 0) {
-        // extend the subtile-height
-        int n = diff * width;
-        for (int i = 0; i < this->celFrameIndices.size(); i++) {
-            QList<quint16> &celFrameIndicesList = this->celFrameIndices[i];
-            for (int j = 0; j < n; j++) {
-                celFrameIndicesList.push_front(0);
-            }
-        }
-    } else if (diff < 0) {
-        diff = -diff;
-        // check if there is a non-zero frame in the subtiles
+    int subtileCount = this->getSubtileCount();
+    int prevSize = width * this->subtileHeight;
+    int newSize = width * height;
+    if (diff < 0) {
+        // check if there is a non-zero frame in the removed rows of the subtiles
         bool hasFrame = false;
-        int n = diff * width;
-        for (int i = 0; i < this->celFrameIndices.size() && !hasFrame; i++) {
-            QList<quint16> &celFrameIndicesList = this->celFrameIndices[i];
-            for (int j = 0; j < n; j++) {
-                if (celFrameIndicesList[j] != 0) {
-                    hasFrame = true;
-                    break;
-                }
-            }
+        int n = -diff * width;
+        for (int i = 0; i < subtileCount && !hasFrame; i++) {
+            auto first = this->celFrameIndices.cbegin() + (size_t)i * prevSize;
+            hasFrame = std::any_of(first, first + n, [](quint16 frameRef) { return frameRef != 0; });
         }
         if (hasFrame) {
             QMessageBox::StandardButton reply;
@@ -224,52 +279,110 @@ void D1Min::setSubtileHeight(int height)
                 return;
             }
         }
-        // reduce the subtile-height
-        for (int i = 0; i < this->celFrameIndices.size(); i++) {
-            QList<quint16> &celFrameIndicesList = this->celFrameIndices[i];
-            celFrameIndicesList.erase(celFrameIndicesList.begin(), celFrameIndicesList.begin() + n);
+    }
+    if (diff != 0) {
+        // move the subtiles to the new stride (the rows are added/removed at the top)
+        std::vector<quint16> newCelFrameIndices((size_t)subtileCount * newSize, 0);
+        int n = std::min(prevSize, newSize);
+        for (int i = 0; i < subtileCount; i++) {
+            std::copy_n(this->celFrameIndices.cbegin() + (size_t)(i + 1) * prevSize - n, n, newCelFrameIndices.begin() + (size_t)(i + 1) * newSize - n);
         }
+        this->celFrameIndices.swap(newCelFrameIndices);
     }
     this->subtileHeight = height;
     this->modified = true;
+    this->invalidateSubtiles();
+}
+
+// the frame references of the subtile (the view is valid until the subtiles are added/removed)
+D1EntryView D1Min::getCelFrameIndices(int subtileIndex)
+{
+    const int n = this->subtileWidth * this->subtileHeight;
+    return D1EntryView { this->celFrameIndices.data() + (size_t)subtileIndex * n, n };
+}
+
+// set a frame reference of the subtile and keep the frame -> subtiles index in sync
+void D1Min::setCelFrameIndex(int subtileIndex, int position, quint16 frameRef)
+{
+    const D1EntryView celFrameIndicesList = this->getCelFrameIndices(subtileIndex);
+    quint16 prevFrameRef = celFrameIndicesList[position];
+    if (prevFrameRef == frameRef)
+        return;
+
+    this->celFrameIndices[(size_t)subtileIndex * celFrameIndicesList.size() + position] = frameRef;
+    if (this->frameUsersUpToDate) {
+        if (prevFrameRef != 0 && std::find(celFrameIndicesList.begin(), celFrameIndicesList.end(), prevFrameRef) == celFrameIndicesList.end()) {
+            QList<int> &users = this->frameUsers[prevFrameRef - 1];
+            users.removeOne(subtileIndex);
+            if (users.isEmpty())
+                this->frameUsers.remove(prevFrameRef - 1);
+        }
+        if (frameRef != 0) {
+            QList<int> &users = this->frameUsers[frameRef - 1];
+            auto it = std::lower_bound(users.begin(), users.end(), subtileIndex);
+            if (it == users.end() || *it != subtileIndex)
+                users.insert(it, subtileIndex);
+        }
+    }
+    this->subtileFrames.remove(subtileIndex);
+    this->modified = true;
 }
 
-QList<quint16> &D1Min::getCelFrameIndices(int subtileIndex)
+// replace the frame references of the subtile (missing entries are left unchanged)
+void D1Min::setCelFrameIndices(int subtileIndex, const QList<quint16> &frameRefs)
 {
-    return const_cast<QList<quint16> &>(this->celFrameIndices.at(subtileIndex));
+    const int n = this->subtileWidth * this->subtileHeight;
+    std::copy_n(frameRefs.cbegin(), std::min(n, (int)frameRefs.count()), this->celFrameIndices.begin() + (size_t)subtileIndex * n);
+    this->invalidateSubtile(subtileIndex);
+    this->modified = true;
+}
+
+D1Gfx *D1Min::getGfx()
+{
+    return this->gfx;
 }
 
 void D1Min::insertSubtile(int subtileIndex, const QList<quint16> &frameIndicesList)
 {
-    this->celFrameIndices.insert(subtileIndex, frameIndicesList);
+    const int n = this->subtileWidth * this->subtileHeight;
+    auto entry = this->celFrameIndices.insert(this->celFrameIndices.begin() + (size_t)subtileIndex * n, n, 0);
+    std::copy_n(frameIndicesList.cbegin(), std::min(n, (int)frameIndicesList.count()), entry);
+    this->invalidateSubtiles();
     this->modified = true;
 }
 
 void D1Min::createSubtile()
 {
-    QList<quint16> celFrameIndicesList;
     int n = this->subtileWidth * this->subtileHeight;
 
-    for (int i = 0; i < n; i++) {
-        celFrameIndicesList.append(0);
-    }
-    this->celFrameIndices.append(celFrameIndicesList);
+    this->celFrameIndices.resize(this->celFrameIndices.size() + n, 0);
     this->modified = true;
 }
 
 void D1Min::removeSubtile(int subtileIndex)
 {
-    this->celFrameIndices.removeAt(subtileIndex);
+    const int n = this->subtileWidth * this->subtileHeight;
+    auto entry = this->celFrameIndices.begin() + (size_t)subtileIndex * n;
+    this->celFrameIndices.erase(entry, entry + n);
+    this->invalidateSubtiles();
     this->modified = true;
 }
 
-void D1Min::remapSubtiles(const QMap<unsigned, unsigned> &remap)
+void D1Min::remapSubtiles(const D1IndexRemap &remap)
 {
-    QList<QList<quint16>> newCelFrameIndices;
+    D1Remap::moveEntries(this->celFrameIndices, remap, this->subtileWidth * this->subtileHeight);
+    this->invalidateSubtiles();
+    this->modified = true;
+}
 
-    for (auto iter = remap.cbegin(); iter != remap.cend(); ++iter) {
-        newCelFrameIndices.append(this->celFrameIndices.at(iter.value()));
+// the references to removed frames are cleared
+void D1Min::remapFrameReferences(const D1IndexRemap &frameRemap)
+{
+    for (quint16 &frameRef : this->celFrameIndices) {
+        if (frameRef != 0 && frameRef <= frameRemap.size()) {
+            frameRef = frameRemap[frameRef - 1] + 1;
+        }
     }
-    this->celFrameIndices.swap(newCelFrameIndices);
+    this->invalidateSubtiles();
     this->modified = true;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <map>
+#include <vector>
 
 #include <QImage>
 #include <QList>
@@ -11,6 +12,38 @@
 #include "d1gfx.h"
 #include "d1sol.h"
 
+// Read-only view of the consecutive entries of a subtile or a tile in a flat array (valid until entries are added/removed)
+// The entries are modified through D1Min/D1Til, so their reverse indices stay in sync.
+struct D1EntryView {
+    const quint16 *entries = nullptr;
+    int count = 0;
+
+    const quint16 *begin() const
+    {
+        return this->entries;
+    }
+    const quint16 *end() const
+    {
+        return this->entries + this->count;
+    }
+    int size() const
+    {
+        return this->count;
+    }
+    quint16 operator[](int index) const
+    {
+        return this->entries[index];
+    }
+};
+
+// Composed subtile in the render cache of D1Min
+struct D1MinSubtileFrame {
+    // the content the subtile was composed from
+    std::vector<quint16> celFrameIndices;
+    QList<quint64> frameRevisions;
+    D1GfxFrame frame;
+};
+
 class D1Min : public QObject {
     Q_OBJECT
 
@@ -22,11 +55,20 @@ public:
     bool save(const QString &gfxPath);
 
     QImage getSubtileImage(int subtileIndex);
+    QImage getSubtileIndexedImage(int subtileIndex);
+    const D1GfxFrame *getSubtileFrame(int subtileIndex);
+    void drawSubtile(D1GfxFrame &dst, int x, int y, int subtileIndex);
+    QList<int> getFrameUsers(int frameIndex);
+    // drop the cached subtiles which use the frame and return their indices
+    QList<int> invalidateFrame(int frameIndex);
+    void invalidateSubtile(int subtileIndex);
+    void invalidateSubtiles();
 
     void insertSubtile(int subtileIndex, const QList<quint16> &frameIndicesList);
     void createSubtile();
     void removeSubtile(int subtileIndex);
-    void remapSubtiles(const QMap<unsigned, unsigned> &remap);
+    void remapSubtiles(const D1IndexRemap &remap);
+    void remapFrameReferences(const D1IndexRemap &frameRemap);
 
     bool isModified() const;
     QString getFilePath();
@@ -34,13 +76,24 @@ public:
     quint16 getSubtileWidth();
     quint16 getSubtileHeight();
     void setSubtileHeight(int height);
-    QList<quint16> &getCelFrameIndices(int subtileIndex);
+    D1EntryView getCelFrameIndices(int subtileIndex);
+    void setCelFrameIndex(int subtileIndex, int position, quint16 frameRef);
+    void setCelFrameIndices(int subtileIndex, const QList<quint16> &frameRefs);
+    D1Gfx *getGfx();
 
 private:
     bool modified;
     QString minFilePath;
     D1Gfx *gfx = nullptr;
-    quint8 subtileWidth;
-    quint8 subtileHeight;
-    QList<QList<quint16>> celFrameIndices;
+    quint8 subtileWidth = 0;
+    quint8 subtileHeight = 0;
+    // frame references of the subtiles (subtileWidth * subtileHeight entries per subtile)
+    std::vector<quint16> celFrameIndices;
+    // render cache of the subtiles with the frame -> subtiles dependencies
+    QMap<int, D1MinSubtileFrame> subtileFrames;
+    QMap<int, QList<int>> frameUsers;
+    bool frameUsersUpToDate = false;
+    quint64 subtileRevisionCounter = 0;
+
+    void updateFrameUsers();
 };
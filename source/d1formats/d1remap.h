@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QList>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Dense mapping of old indices to new ones (-1 if the entry is removed)
+typedef std::vector<int> D1IndexRemap;
+
+// Helper class to apply an index remap in one linear pass
+class D1Remap {
+public:
+    // remap of count entries if delta entries are inserted at index (or removed if delta is negative)
+    static D1IndexRemap shiftedIndices(int count, int index, int delta)
+    {
+        D1IndexRemap remap(count);
+        for (int i = 0; i < count; i++) {
+            if (i < index)
+                remap[i] = i;
+            else if (i < index - delta)
+                remap[i] = -1;
+            else
+                remap[i] = i + delta;
+        }
+        return remap;
+    }
+
+    // the remap of count entries, the entries past the end of the remap are kept after the remapped ones
+    static D1IndexRemap completeRemap(const D1IndexRemap &remap, int count)
+    {
+        D1IndexRemap fullRemap(remap.begin(), remap.begin() + std::min((int)remap.size(), count));
+        int nextIndex = 0;
+        for (int newIndex : fullRemap) {
+            nextIndex = std::max(nextIndex, newIndex + 1);
+        }
+        while ((int)fullRemap.size() < count) {
+            fullRemap.push_back(nextIndex++);
+        }
+        return fullRemap;
+    }
+
+    // moves the kept entries of the list to their new positions (the new indices of the kept entries must be 0..n-1)
+    template <typename T>
+    static void moveEntries(QList<T> &list, const D1IndexRemap &remap)
+    {
+        const D1IndexRemap fullRemap = D1Remap::completeRemap(remap, list.count());
+        std::vector<int> oldIndices;
+        for (int i = 0; i < (int)fullRemap.size(); i++) {
+            int newIndex = fullRemap[i];
+            if (newIndex < 0)
+                continue;
+            if (newIndex >= (int)oldIndices.size())
+                oldIndices.resize(newIndex + 1, -1);
+            oldIndices[newIndex] = i;
+        }
+
+        QList<T> newList;
+        newList.reserve(oldIndices.size());
+        for (int oldIndex : oldIndices) {
+            // entries without a source (invalid remap) are default-initialized
+            newList.append(oldIndex >= 0 ? std::move(list[oldIndex]) : T());
+        }
+        list.swap(newList);
+    }
+
+    // moves the kept entries of a flat array (stride values per entry) to their new positions
+    template <typename T>
+    static void moveEntries(std::vector<T> &entries, const D1IndexRemap &remap, int stride)
+    {
+        const D1IndexRemap fullRemap = D1Remap::completeRemap(remap, entries.size() / stride);
+        std::vector<T> newEntries;
+        for (int i = 0; i < (int)fullRemap.size(); i++) {
+            int newIndex = fullRemap[i];
+            if (newIndex < 0)
+                continue;
+            // entries without a source (invalid remap) are value-initialized
+            if ((size_t)(newIndex + 1) * stride > newEntries.size())
+                newEntries.resize((size_t)(newIndex + 1) * stride);
+            auto first = entries.begin() + (size_t)i * stride;
+            std::move(first, first + stride, newEntries.begin() + (size_t)newIndex * stride);
+        }
+        entries.swap(newEntries);
+    }
+};
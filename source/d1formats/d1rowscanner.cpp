@@ -0,0 +1,120 @@
+#include "d1rowscanner.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define D1_ROWSCAN_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define D1_ROWSCAN_NEON
+#endif
+
+namespace {
+
+// length of the run of equal bits starting at x
+int maskRunLength(const quint8 *maskRow, int x, int width, bool transparent)
+{
+    const int maskStride = (width + 7) / 8;
+    int pos = x;
+    while (pos < width) {
+        // load the next (up to) 64 bits of the mask
+        const int byteIdx = pos >> 3;
+        const int numBytes = std::min(8, maskStride - byteIdx);
+        quint64 bits = 0;
+        memcpy(&bits, &maskRow[byteIdx], numBytes);
+        bits = qFromLittleEndian(bits);
+        const int shift = pos & 7;
+        bits >>= shift;
+        if (!transparent)
+            bits = ~bits;
+        const int numBits = numBytes * 8 - shift;
+        const int run = std::countr_one(bits);
+        if (run < numBits) {
+            pos += run;
+            break;
+        }
+        pos += numBits;
+    }
+    // the padding bits are set, so a transparent run might reach past the end of the row
+    return std::min(pos, width) - x;
+}
+
+} // namespace
+
+int D1RowScanner::transparentRunLength(const quint8 *maskRow, int x, int width)
+{
+    return maskRunLength(maskRow, x, width, true);
+}
+
+int D1RowScanner::opaqueRunLength(const quint8 *maskRow, int x, int width)
+{
+    return maskRunLength(maskRow, x, width, false);
+}
+
+int D1RowScanner::equalRunLength(const quint8 *indexRow, int x, int end)
+{
+    const quint8 color = indexRow[x];
+    int i = x + 1;
+#if defined(__AVX2__)
+    const __m256i needle32 = _mm256_set1_epi8((char)color);
+    for (; i + 32 <= end; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&indexRow[i]));
+        const quint32 diff = ~(quint32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle32));
+        if (diff != 0)
+            return i + std::countr_zero(diff) - x;
+    }
+#endif
+#if defined(D1_ROWSCAN_SSE2)
+    const __m128i needle = _mm_set1_epi8((char)color);
+    for (; i + 16 <= end; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&indexRow[i]));
+        const quint32 diff = (quint32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)) ^ 0xFFFF;
+        if (diff != 0)
+            return i + std::countr_zero(diff) - x;
+    }
+#elif defined(D1_ROWSCAN_NEON)
+    const uint8x16_t needle = vdupq_n_u8(color);
+    for (; i + 16 <= end; i += 16) {
+        const uint8x16_t eq = vceqq_u8(vld1q_u8(&indexRow[i]), needle);
+        // narrow the compare result to four bits per byte
+        const quint64 diff = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (diff != 0)
+            return i + (std::countr_zero(diff) >> 2) - x;
+    }
+#endif
+    while (i < end && indexRow[i] == color) {
+        i++;
+    }
+    return i - x;
+}
+
+quint32 D1RowScanner::orPixels(const quint32 *pixels, int count)
+{
+    quint32 result = 0;
+    int i = 0;
+#if defined(D1_ROWSCAN_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(&pixels[i])));
+    }
+    acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = (quint32)_mm_cvtsi128_si32(acc);
+#elif defined(D1_ROWSCAN_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 4 <= count; i += 4) {
+        acc = vorrq_u32(acc, vld1q_u32(&pixels[i]));
+    }
+    uint32x2_t acc2 = vorr_u32(vget_low_u32(acc), vget_high_u32(acc));
+    result = vget_lane_u32(acc2, 0) | vget_lane_u32(acc2, 1);
+#endif
+    for (; i < count; i++) {
+        result |= pixels[i];
+    }
+    return result;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Helper class to find pixel runs in the rows of a D1GfxFrame
+// The transparency mask is scanned 64 pixels at a time, the palette indices and image pixels with SSE2/AVX2/NEON if available.
+class D1RowScanner {
+public:
+    // number of consecutive transparent/opaque pixels starting at x (x < width)
+    static int transparentRunLength(const quint8 *maskRow, int x, int width);
+    static int opaqueRunLength(const quint8 *maskRow, int x, int width);
+    // number of consecutive pixels with the color of indexRow[x] (x < end)
+    static int equalRunLength(const quint8 *indexRow, int x, int end);
+    // bitwise OR of the (32-bit) pixels
+    static quint32 orPixels(const quint32 *pixels, int count);
+};
@@ -1,46 +1,27 @@
 #include "d1sol.h"
 
-#include <QBuffer>
-#include <QDataStream>
 #include <QFile>
-#include <QFileInfo>
 #include <QMessageBox>
 
+#include "d1dataview.h"
+
 bool D1Sol::load(QString filePath)
 {
-    // prepare file data source
-    QFile file;
+    // prepare file data source (memory-mapped)
+    D1FileData file;
     // done by the caller
     // if (!params.solFilePath.isEmpty()) {
     //    filePath = params.solFilePath;
     // }
     if (!filePath.isEmpty()) {
-        file.setFileName(filePath);
-        if (!file.open(QIODevice::ReadOnly)) {
+        if (!file.open(filePath)) {
             return false;
         }
     }
+    const D1DataView in = file.view();
 
-    QByteArray fileData = file.readAll();
-    QBuffer fileBuffer(&fileData);
-
-    if (!fileBuffer.open(QIODevice::ReadOnly)) {
-        return false;
-    }
-
-    int subTileCount = file.size();
-
-    this->subProperties.clear();
-
-    // Read SOL binary data
-    QDataStream in(&fileBuffer);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    for (int i = 0; i < subTileCount; i++) {
-        quint8 readBytr;
-        in >> readBytr;
-        this->subProperties.append(readBytr);
-    }
+    // Read SOL binary data in one go
+    this->subProperties.assign(in.data(), in.data() + in.size());
 
     this->solFilePath = filePath;
     this->modified = false;
@@ -61,10 +42,7 @@ bool D1Sol::save(const QString &gfxPath)
     }
 
     // write to file
-    QDataStream out(&outFile);
-    for (int i = 0; i < this->subProperties.size(); i++) {
-        out << this->subProperties[i];
-    }
+    outFile.write(reinterpret_cast<const char *>(this->subProperties.data()), this->subProperties.size());
 
     this->solFilePath = filePath;
     this->modified = false;
@@ -84,20 +62,20 @@ QString D1Sol::getFilePath()
 
 quint16 D1Sol::getSubtileCount()
 {
-    return this->subProperties.count();
+    return this->subProperties.size();
 }
 
 quint8 D1Sol::getSubtileProperties(int subtileIndex)
 {
-    if (subtileIndex >= this->subProperties.count())
+    if (subtileIndex < 0 || subtileIndex >= (int)this->subProperties.size())
         return 0;
 
-    return this->subProperties.at(subtileIndex);
+    return this->subProperties[subtileIndex];
 }
 
 void D1Sol::insertSubtile(int subtileIndex, quint8 value)
 {
-    this->subProperties.insert(subtileIndex, value);
+    this->subProperties.insert(this->subProperties.begin() + subtileIndex, value);
     this->modified = true;
 }
 
@@ -109,23 +87,18 @@ void D1Sol::setSubtileProperties(int subtileIndex, quint8 value)
 
 void D1Sol::createSubtile()
 {
-    this->subProperties.append(0);
+    this->subProperties.push_back(0);
     this->modified = true;
 }
 
 void D1Sol::removeSubtile(int subtileIndex)
 {
-    this->subProperties.removeAt(subtileIndex);
+    this->subProperties.erase(this->subProperties.begin() + subtileIndex);
     this->modified = true;
 }
 
-void D1Sol::remapSubtiles(const QMap<unsigned, unsigned> &remap)
+void D1Sol::remapSubtiles(const D1IndexRemap &remap)
 {
-    QList<quint8> newSubProperties;
-
-    for (auto iter = remap.cbegin(); iter != remap.cend(); ++iter) {
-        newSubProperties.append(this->subProperties.at(iter.value()));
-    }
-    this->subProperties.swap(newSubProperties);
+    D1Remap::moveEntries(this->subProperties, remap, 1);
     this->modified = true;
 }
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <vector>
+
 #include <QList>
-#include <QMap>
 #include <QObject>
 #include <QString>
 
+#include "d1remap.h"
+
 class D1Sol : public QObject {
     Q_OBJECT
 
@@ -18,7 +21,7 @@ public:
     void insertSubtile(int subtileIndex, quint8 value);
     void createSubtile();
     void removeSubtile(int subtileIndex);
-    void remapSubtiles(const QMap<unsigned, unsigned> &remap);
+    void remapSubtiles(const D1IndexRemap &remap);
 
     bool isModified() const;
     QString getFilePath();
@@ -29,5 +32,5 @@ public:
 private:
     bool modified;
     QString solFilePath;
-    QList<quint8> subProperties;
+    std::vector<quint8> subProperties;
 };
@@ -1,38 +1,33 @@
 #include "d1til.h"
 
-#include <QBuffer>
+#include <algorithm>
+
 #include <QDebug>
 #include <QFile>
-#include <QFileInfo>
 #include <QMessageBox>
-#include <QPainter>
+#include <QtEndian>
+
+#include "d1dataview.h"
 
 #define TILE_SIZE (TILE_WIDTH * TILE_HEIGHT)
 
 bool D1Til::load(QString filePath, D1Min *m)
 {
-    // prepare file data source
-    QFile file;
+    // prepare file data source (memory-mapped)
+    D1FileData file;
     // done by the caller
     // if (!params.tilFilePath.isEmpty()) {
     //    filePath = params.tilFilePath;
     // }
     if (!filePath.isEmpty()) {
-        file.setFileName(filePath);
-        if (!file.open(QIODevice::ReadOnly)) {
+        if (!file.open(filePath)) {
             return false;
         }
     }
-
-    QByteArray fileData = file.readAll();
-    QBuffer fileBuffer(&fileData);
-
-    if (!fileBuffer.open(QIODevice::ReadOnly)) {
-        return false;
-    }
+    const D1DataView in = file.view();
 
     // File size check
-    auto fileSize = file.size();
+    auto fileSize = in.size();
     if (fileSize % (2 * TILE_SIZE) != 0) {
         qDebug() << "Invalid til-file.";
         return false;
@@ -42,20 +37,12 @@ bool D1Til::load(QString filePath, D1Min *m)
 
     int tileCount = fileSize / (2 * TILE_SIZE);
 
-    // Read TIL binary data
-    QDataStream in(&fileBuffer);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    this->subtileIndices.clear();
-    for (int i = 0; i < tileCount; i++) {
-        QList<quint16> subtileIndicesList;
-        for (int j = 0; j < TILE_SIZE; j++) {
-            quint16 readWord;
-            in >> readWord;
-            subtileIndicesList.append(readWord);
-        }
-        this->subtileIndices.append(subtileIndicesList);
+    // Read TIL binary data in one go
+    this->subtileIndices.resize((size_t)tileCount * TILE_SIZE);
+    if (tileCount != 0) {
+        qFromLittleEndian<quint16>(in.data(), tileCount * TILE_SIZE, this->subtileIndices.data());
     }
+    this->invalidateTiles();
 
     this->tilFilePath = filePath;
     this->modified = false;
@@ -76,15 +63,9 @@ bool D1Til::save(const QString &gfxPath)
     }
 
     // write to file
-    QDataStream out(&outFile);
-    out.setByteOrder(QDataStream::LittleEndian);
-    for (int i = 0; i < this->subtileIndices.count(); i++) {
-        QList<quint16> &subtileIndicesList = this->subtileIndices[i];
-        for (int j = 0; j < TILE_SIZE; j++) {
-            quint16 writeWord = subtileIndicesList[j];
-            out << writeWord;
-        }
-    }
+    std::vector<quint16> outData(this->subtileIndices.size());
+    qToLittleEndian<quint16>(this->subtileIndices.data(), outData.size(), outData.data());
+    outFile.write(reinterpret_cast<const char *>(outData.data()), outData.size() * sizeof(quint16));
 
     this->tilFilePath = filePath;
     this->modified = false;
@@ -94,59 +75,140 @@ bool D1Til::save(const QString &gfxPath)
 
 QImage D1Til::getTileImage(int tileIndex)
 {
-    if (tileIndex < 0 || tileIndex >= this->subtileIndices.size())
+    const D1GfxFrame *tile = this->getTileFrame(tileIndex);
+    if (tile == nullptr)
         return QImage();
 
-    unsigned subtileWidth = this->min->getSubtileWidth() * MICRO_WIDTH;
-    unsigned subtileHeight = this->min->getSubtileHeight() * MICRO_HEIGHT;
-    // assert(TILE_WIDTH == 2 &&  TILE_HEIGHT == 2);
-    unsigned subtileShiftY = subtileWidth / 4;
-    QImage tile = QImage(subtileWidth * 2,
-        subtileHeight + 2 * subtileShiftY, QImage::Format_ARGB32);
-    tile.fill(Qt::transparent);
-    QPainter tilePainter(&tile);
-    //      0
-    //    2   1
-    //      3
-    tilePainter.drawImage(subtileWidth / 2, 0,
-        this->min->getSubtileImage(
-            this->subtileIndices.at(tileIndex).at(0)));
-
-    tilePainter.drawImage(subtileWidth, subtileShiftY,
-        this->min->getSubtileImage(
-            this->subtileIndices.at(tileIndex).at(1)));
-
-    tilePainter.drawImage(0, subtileShiftY,
-        this->min->getSubtileImage(
-            this->subtileIndices.at(tileIndex).at(2)));
-
-    tilePainter.drawImage(subtileWidth / 2, 2 * subtileShiftY,
-        this->min->getSubtileImage(
-            this->subtileIndices.at(tileIndex).at(3)));
-
-    tilePainter.end();
-    return tile;
+    return this->min->getGfx()->renderFrameImage(*tile);
+}
+
+QImage D1Til::getTileIndexedImage(int tileIndex)
+{
+    const D1GfxFrame *tile = this->getTileFrame(tileIndex);
+    if (tile == nullptr)
+        return QImage();
+
+    return this->min->getGfx()->renderFrameIndexedImage(*tile);
+}
+
+// returns the tile composed in palette-index space (the pointer is valid until the cache is invalidated)
+const D1GfxFrame *D1Til::getTileFrame(int tileIndex)
+{
+    if (tileIndex < 0 || tileIndex >= this->getTileCount())
+        return nullptr;
+
+    const D1EntryView subtiles = this->getSubtileIndices(tileIndex);
+    QList<const D1GfxFrame *> subtileFrames;
+    QList<quint64> subtileRevisions;
+    for (quint16 subtileIndex : subtiles) {
+        const D1GfxFrame *subtile = this->min->getSubtileFrame(subtileIndex);
+        subtileFrames.append(subtile);
+        subtileRevisions.append(subtile != nullptr ? subtile->revision : 0);
+    }
+
+    // the entries are checked against the current content in case the TIL or the subtiles were edited directly
+    auto it = this->tileFrames.find(tileIndex);
+    if (it == this->tileFrames.end() || !std::equal(it.value().subtileIndices.cbegin(), it.value().subtileIndices.cend(), subtiles.begin(), subtiles.end()) || it.value().subtileRevisions != subtileRevisions) {
+        unsigned subtileWidth = this->min->getSubtileWidth() * MICRO_WIDTH;
+        unsigned subtileHeight = this->min->getSubtileHeight() * MICRO_HEIGHT;
+        // assert(TILE_WIDTH == 2 &&  TILE_HEIGHT == 2);
+        unsigned subtileShiftY = subtileWidth / 4;
+        // the tile is composed in palette-index space from the cached subtiles
+        D1TilTileFrame &entry = this->tileFrames[tileIndex];
+        entry.subtileIndices.assign(subtiles.begin(), subtiles.end());
+        entry.subtileRevisions = subtileRevisions;
+        D1GfxFrame &tile = entry.frame;
+        tile.resize(subtileWidth * 2, subtileHeight + 2 * subtileShiftY);
+        //      0
+        //    2   1
+        //      3
+        const int positions[TILE_SIZE][2] = {
+            { (int)subtileWidth / 2, 0 },
+            { (int)subtileWidth, (int)subtileShiftY },
+            { 0, (int)subtileShiftY },
+            { (int)subtileWidth / 2, 2 * (int)subtileShiftY },
+        };
+        for (int i = 0; i < TILE_SIZE && i < subtileFrames.count(); i++) {
+            if (subtileFrames[i] != nullptr)
+                tile.drawFrame(positions[i][0], positions[i][1], *subtileFrames[i]);
+        }
+        it = this->tileFrames.find(tileIndex);
+    }
+
+    return &it.value().frame;
 }
 
 QImage D1Til::getFlatTileImage(int tileIndex)
 {
-    if (tileIndex < 0 || tileIndex >= this->subtileIndices.size())
+    if (tileIndex < 0 || tileIndex >= this->getTileCount())
         return QImage();
 
     unsigned subtileWidth = this->min->getSubtileWidth() * MICRO_WIDTH;
     unsigned subtileHeight = this->min->getSubtileHeight() * MICRO_HEIGHT;
-    QImage tile = QImage(subtileWidth * TILE_SIZE, subtileHeight, QImage::Format_ARGB32);
-    tile.fill(Qt::transparent);
-    QPainter tilePainter(&tile);
+    D1GfxFrame tile;
+    tile.resize(subtileWidth * TILE_SIZE, subtileHeight);
 
     for (int i = 0; i < TILE_SIZE; i++) {
-        tilePainter.drawImage(subtileWidth * i, 0,
-            this->min->getSubtileImage(
-                this->subtileIndices.at(tileIndex).at(i)));
+        const D1GfxFrame *subtile = this->min->getSubtileFrame(this->subtileIndices[(size_t)tileIndex * TILE_SIZE + i]);
+        if (subtile != nullptr)
+            tile.drawFrame(subtileWidth * i, 0, *subtile);
+    }
+
+    return this->min->getGfx()->renderFrameImage(tile);
+}
+
+// rebuild the subtile -> tiles index after a structural change
+void D1Til::updateSubtileUsers()
+{
+    if (this->subtileUsersUpToDate)
+        return;
+
+    this->subtileUsers.clear();
+    for (int i = 0; i < this->getTileCount(); i++) {
+        for (quint16 index : this->getSubtileIndices(i)) {
+            QList<int> &users = this->subtileUsers[index];
+            if (users.isEmpty() || users.last() != i)
+                users.append(i);
+        }
+    }
+    this->subtileUsersUpToDate = true;
+}
+
+// returns the (ascending) indices of the tiles which use the subtile
+QList<int> D1Til::getSubtileUsers(int subtileIndex)
+{
+    this->updateSubtileUsers();
+    return this->subtileUsers.value(subtileIndex);
+}
+
+void D1Til::invalidateFrame(int frameIndex)
+{
+    const QList<int> subtiles = this->min->invalidateFrame(frameIndex);
+    for (int subtileIndex : subtiles) {
+        this->invalidateSubtile(subtileIndex);
     }
+}
 
-    tilePainter.end();
-    return tile;
+// the image of the subtile changed (the MIN-entry is handled by D1Min)
+void D1Til::invalidateSubtile(int subtileIndex)
+{
+    const QList<int> users = this->getSubtileUsers(subtileIndex);
+    for (int tileIndex : users) {
+        this->tileFrames.remove(tileIndex);
+    }
+}
+
+// the TIL-entry of the tile changed
+void D1Til::invalidateTile(int tileIndex)
+{
+    this->tileFrames.remove(tileIndex);
+    this->subtileUsersUpToDate = false;
+}
+
+void D1Til::invalidateTiles()
+{
+    this->tileFrames.clear();
+    this->subtileUsersUpToDate = false;
 }
 
 bool D1Til::isModified() const
@@ -161,33 +223,89 @@ QString D1Til::getFilePath()
 
 int D1Til::getTileCount()
 {
-    return this->subtileIndices.count();
+    return (int)(this->subtileIndices.size() / TILE_SIZE);
+}
+
+// the subtile references of the tile (the view is valid until the tiles are added/removed)
+D1EntryView D1Til::getSubtileIndices(int tileIndex)
+{
+    return D1EntryView { this->subtileIndices.data() + (size_t)tileIndex * TILE_SIZE, TILE_SIZE };
+}
+
+// set a subtile reference of the tile and keep the subtile -> tiles index in sync
+void D1Til::setSubtileIndex(int tileIndex, int position, quint16 subtileRef)
+{
+    const D1EntryView subtileIndicesList = this->getSubtileIndices(tileIndex);
+    quint16 prevSubtileRef = subtileIndicesList[position];
+    if (prevSubtileRef == subtileRef)
+        return;
+
+    this->subtileIndices[(size_t)tileIndex * TILE_SIZE + position] = subtileRef;
+    if (this->subtileUsersUpToDate) {
+        if (std::find(subtileIndicesList.begin(), subtileIndicesList.end(), prevSubtileRef) == subtileIndicesList.end()) {
+            QList<int> &users = this->subtileUsers[prevSubtileRef];
+            users.removeOne(tileIndex);
+            if (users.isEmpty())
+                this->subtileUsers.remove(prevSubtileRef);
+        }
+        QList<int> &users = this->subtileUsers[subtileRef];
+        auto it = std::lower_bound(users.begin(), users.end(), tileIndex);
+        if (it == users.end() || *it != tileIndex)
+            users.insert(it, tileIndex);
+    }
+    this->tileFrames.remove(tileIndex);
+    this->modified = true;
 }
 
-QList<quint16> &D1Til::getSubtileIndices(int tileIndex)
+// replace the subtile references of the tile (missing entries are left unchanged)
+void D1Til::setSubtileIndices(int tileIndex, const QList<quint16> &subtileRefs)
 {
-    return const_cast<QList<quint16> &>(this->subtileIndices.at(tileIndex));
+    std::copy_n(subtileRefs.cbegin(), std::min(TILE_SIZE, (int)subtileRefs.count()), this->subtileIndices.begin() + (size_t)tileIndex * TILE_SIZE);
+    this->invalidateTile(tileIndex);
+    this->modified = true;
 }
 
 void D1Til::insertTile(int tileIndex, const QList<quint16> &subtileIndices)
 {
-    this->subtileIndices.insert(tileIndex, subtileIndices);
+    auto entry = this->subtileIndices.insert(this->subtileIndices.begin() + (size_t)tileIndex * TILE_SIZE, TILE_SIZE, 0);
+    std::copy_n(subtileIndices.cbegin(), std::min(TILE_SIZE, (int)subtileIndices.count()), entry);
+    this->invalidateTiles();
     this->modified = true;
 }
 
 void D1Til::createTile()
 {
-    QList<quint16> subtileIndices;
-
-    for (int i = 0; i < TILE_SIZE; i++) {
-        subtileIndices.append(0);
+    this->subtileIndices.resize(this->subtileIndices.size() + TILE_SIZE, 0);
+    if (this->subtileUsersUpToDate) {
+        // the new tile is the last user of the first subtile
+        this->subtileUsers[0].append(this->getTileCount() - 1);
     }
-    this->subtileIndices.append(subtileIndices);
     this->modified = true;
 }
 
 void D1Til::removeTile(int tileIndex)
 {
-    this->subtileIndices.removeAt(tileIndex);
+    auto entry = this->subtileIndices.begin() + (size_t)tileIndex * TILE_SIZE;
+    this->subtileIndices.erase(entry, entry + TILE_SIZE);
+    this->invalidateTiles();
+    this->modified = true;
+}
+
+void D1Til::remapTiles(const D1IndexRemap &remap)
+{
+    D1Remap::moveEntries(this->subtileIndices, remap, TILE_SIZE);
+    this->invalidateTiles();
+    this->modified = true;
+}
+
+// the references to removed subtiles are set to the first subtile
+void D1Til::remapSubtileReferences(const D1IndexRemap &subtileRemap)
+{
+    for (quint16 &subtileRef : this->subtileIndices) {
+        if (subtileRef < subtileRemap.size()) {
+            subtileRef = std::max(0, subtileRemap[subtileRef]);
+        }
+    }
+    this->invalidateTiles();
     this->modified = true;
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <vector>
+
 #include <QImage>
 #include <QList>
+#include <QMap>
 #include <QString>
 
 #include "d1min.h"
@@ -9,6 +12,14 @@
 #define TILE_WIDTH 2
 #define TILE_HEIGHT 2
 
+// Composed tile in the render cache of D1Til
+struct D1TilTileFrame {
+    // the content the tile was composed from
+    std::vector<quint16> subtileIndices;
+    QList<quint64> subtileRevisions;
+    D1GfxFrame frame;
+};
+
 class D1Til : public QObject {
     Q_OBJECT
 
@@ -20,19 +31,38 @@ public:
     bool save(const QString &gfxPath);
 
     QImage getTileImage(int tileIndex);
+    QImage getTileIndexedImage(int tileIndex);
     QImage getFlatTileImage(int tileIndex);
+    QList<int> getSubtileUsers(int subtileIndex);
+    // drop the cached tiles which depend on the frame or on the subtile
+    void invalidateFrame(int frameIndex);
+    void invalidateSubtile(int subtileIndex);
+    void invalidateTile(int tileIndex);
+    void invalidateTiles();
     void insertTile(int tileIndex, const QList<quint16> &subtileIndices);
     void createTile();
     void removeTile(int tileIndex);
+    void remapTiles(const D1IndexRemap &remap);
+    void remapSubtileReferences(const D1IndexRemap &subtileRemap);
 
     bool isModified() const;
     QString getFilePath();
     int getTileCount();
-    QList<quint16> &getSubtileIndices(int tileIndex);
+    D1EntryView getSubtileIndices(int tileIndex);
+    void setSubtileIndex(int tileIndex, int position, quint16 subtileRef);
+    void setSubtileIndices(int tileIndex, const QList<quint16> &subtileRefs);
 
 private:
     bool modified;
     QString tilFilePath;
     D1Min *min = nullptr;
-    QList<QList<quint16>> subtileIndices;
+    // subtile references of the tiles (TILE_WIDTH * TILE_HEIGHT entries per tile)
+    std::vector<quint16> subtileIndices;
+    // render cache of the tiles with the subtile -> tiles dependencies
+    QMap<int, D1TilTileFrame> tileFrames;
+    QMap<int, QList<int>> subtileUsers;
+    bool subtileUsersUpToDate = false;
+
+    const D1GfxFrame *getTileFrame(int tileIndex);
+    void updateSubtileUsers();
 };
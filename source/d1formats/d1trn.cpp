@@ -57,10 +57,12 @@ bool D1Trn::isModified() const
 
 void D1Trn::refreshResultingPalette()
 {
+    // set the colors in one batch so the generation of the palette changes at most once
+    QColor colors[D1TRN_TRANSLATIONS];
     for (int i = 0; i < D1TRN_TRANSLATIONS; i++) {
-        this->resultingPalette.setColor(
-            i, this->palette->getColor(this->translations[i]));
+        colors[i] = this->palette->getColor(this->translations[i]);
     }
+    this->resultingPalette.setColors(colors);
 }
 
 QColor D1Trn::getResultingColor(quint8 index)
@@ -25,6 +25,11 @@ void SettingsDialog::initialize()
 
     QColor palSelectionBorderColor = QColor(Config::value("PaletteSelectionBorderColor").toString());
     this->ui->paletteSelectionBorderColorLineEdit->setText(palSelectionBorderColor.name());
+
+    this->ui->decodedFramesLimitSpinBox->setValue(Config::value("DecodedFramesLimit").toInt());
+    this->ui->frameImageCacheLimitSpinBox->setValue(Config::value("FrameImageCacheLimit").toInt());
+
+    this->ui->optimalCl2EncodingCheckBox->setChecked(Config::value("OptimalCl2Encoding").toBool());
 }
 
 void SettingsDialog::on_defaultPaletteColorPushButton_clicked()
@@ -55,6 +60,15 @@ void SettingsDialog::on_settingsOkButton_clicked()
     QColor palSelectionBorderColor = QColor(ui->paletteSelectionBorderColorLineEdit->text());
     Config::insert("PaletteSelectionBorderColor", palSelectionBorderColor.name());
 
+    // DecodedFramesLimit
+    Config::insert("DecodedFramesLimit", this->ui->decodedFramesLimitSpinBox->value());
+
+    // FrameImageCacheLimit
+    Config::insert("FrameImageCacheLimit", this->ui->frameImageCacheLimitSpinBox->value());
+
+    // OptimalCl2Encoding
+    Config::insert("OptimalCl2Encoding", this->ui->optimalCl2EncodingCheckBox->isChecked());
+
     Config::storeConfiguration();
 
     emit this->configurationSaved();
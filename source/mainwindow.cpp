@@ -71,6 +71,9 @@ MainWindow::MainWindow()
     QObject::connect(this->undoAction, SIGNAL(triggered()), this, SLOT(actionUndo_triggered()));
     QObject::connect(this->redoAction, SIGNAL(triggered()), this, SLOT(actionRedo_triggered()));
 
+    // Configuration update applies the memory limits
+    QObject::connect(&this->settingsDialog, &SettingsDialog::configurationSaved, this, &MainWindow::reloadConfig);
+
     // Initialize 'Frame' submenu of 'Edit'
     this->frameMenu.setToolTipsVisible(true);
     this->frameMenu.addAction("Insert", this, SLOT(actionInsertFrame_triggered()))->setToolTip("Add new frames before the current one");
@@ -146,6 +149,14 @@ QString MainWindow::getLastFilePath()
     return this->lastFilePath;
 }
 
+void MainWindow::reloadConfig()
+{
+    if (this->gfx != nullptr) {
+        this->gfx->setDecodedFramesLimit(Config::value("DecodedFramesLimit").toInt() * 1024LL * 1024LL);
+        this->gfx->setFrameImageCacheLimit(Config::value("FrameImageCacheLimit").toInt() * 1024LL * 1024LL);
+    }
+}
+
 void MainWindow::updateWindow()
 {
     // rebuild palette hits
@@ -192,13 +203,17 @@ void MainWindow::paletteWidget_callback(PaletteWidget *widget, PWIDGET_CALLBACK_
 
 void MainWindow::resetPaletteCycle()
 {
-    // this->pal->resetColors();
+    this->m_palWidget->pal()->resetColors();
+    // update the resulting palettes of the translations and the views
+    this->m_palWidget->refresh();
     this->m_palWidget->modify();
 }
 
 void MainWindow::nextPaletteCycle(D1PAL_CYCLE_TYPE type)
 {
-    // this->pal->cycleColors(type);
+    this->m_palWidget->pal()->cycleColors(type);
+    // update the resulting palettes of the translations and the views
+    this->m_palWidget->refresh();
     this->m_palWidget->modify();
 }
 
@@ -423,6 +438,7 @@ void MainWindow::openFile(const OpenAsParam &params)
 
     this->gfx = new D1Gfx();
     this->gfx->setPalette(newTrn->getResultingPalette());
+    this->reloadConfig();
     if (isTileset) {
         // Loading SOL
         this->sol = new D1Sol();
@@ -522,9 +538,9 @@ void MainWindow::openFile(const OpenAsParam &params)
         this->levelCelView->initialize(this->gfx, this->min, this->til, this->sol, this->amp);
 
         // Refresh CEL view if a PAL or TRN is modified
-        QObject::connect(this->m_palWidget, &PaletteWidget::modified, this->levelCelView, &LevelCelView::displayFrame);
-        QObject::connect(this->m_trnUniqueWidget, &PaletteWidget::modified, this->levelCelView, &LevelCelView::displayFrame);
-        QObject::connect(this->m_trnWidget, &PaletteWidget::modified, this->levelCelView, &LevelCelView::displayFrame);
+        QObject::connect(this->m_palWidget, &PaletteWidget::modified, this->levelCelView, &LevelCelView::refreshPalette);
+        QObject::connect(this->m_trnUniqueWidget, &PaletteWidget::modified, this->levelCelView, &LevelCelView::refreshPalette);
+        QObject::connect(this->m_trnWidget, &PaletteWidget::modified, this->levelCelView, &LevelCelView::refreshPalette);
 
         // Select color when level CEL view clicked
         QObject::connect(this->levelCelView, &LevelCelView::colorIndexClicked, this->m_palWidget, &PaletteWidget::selectColor);
@@ -548,9 +564,9 @@ void MainWindow::openFile(const OpenAsParam &params)
         this->celView->initialize(this->gfx);
 
         // Refresh CEL view if a PAL or TRN is modified
-        QObject::connect(this->m_palWidget, &PaletteWidget::modified, this->celView, &CelView::displayFrame);
-        QObject::connect(this->m_trnUniqueWidget, &PaletteWidget::modified, this->celView, &CelView::displayFrame);
-        QObject::connect(this->m_trnWidget, &PaletteWidget::modified, this->celView, &CelView::displayFrame);
+        QObject::connect(this->m_palWidget, &PaletteWidget::modified, this->celView, &CelView::refreshPalette);
+        QObject::connect(this->m_trnUniqueWidget, &PaletteWidget::modified, this->celView, &CelView::refreshPalette);
+        QObject::connect(this->m_trnWidget, &PaletteWidget::modified, this->celView, &CelView::refreshPalette);
 
         // Select color when CEL view clicked
         QObject::connect(this->celView, &CelView::colorIndexClicked, this->m_palWidget, &PaletteWidget::selectColor);
@@ -707,6 +723,7 @@ void MainWindow::saveFile(const QString &gfxPath)
     this->ui->statusBar->repaint();
 
     bool change = false;
+    qint64 bytesSaved = 0;
     QString filePath = gfxPath.isEmpty() ? this->gfx->getFilePath() : gfxPath;
     if (this->gfx->isTileset()) {
         change = D1CelTileset::save(*this->gfx, gfxPath);
@@ -714,10 +731,13 @@ void MainWindow::saveFile(const QString &gfxPath)
         if (filePath.toLower().endsWith("cel")) {
             this->gfx->setHasHeader(this->ui->actionCelHeader->isChecked());
             change = D1Cel::save(*this->gfx, gfxPath);
-        } else if (filePath.toLower().endsWith("cl2")) {
-            change = D1Cl2::save(*this->gfx, false, gfxPath);
-        } else if (filePath.toLower().endsWith("clx")) {
-            change = D1Cl2::save(*this->gfx, true, gfxPath);
+        } else if (filePath.toLower().endsWith("cl2") || filePath.toLower().endsWith("clx")) {
+            bool isClx = filePath.toLower().endsWith("clx");
+            if (Config::value("OptimalCl2Encoding").toBool()) {
+                change = D1Cl2::save(*this->gfx, isClx, gfxPath, D1CL2_ENCODING::OPTIMAL, &bytesSaved);
+            } else {
+                change = D1Cl2::save(*this->gfx, isClx, gfxPath);
+            }
         } else {
             QMessageBox::critical(this, "Error", "Not supported.");
             // Clear loading message from status bar
@@ -753,6 +773,9 @@ void MainWindow::saveFile(const QString &gfxPath)
 
     // Clear loading message from status bar
     this->ui->statusBar->clearMessage();
+    if (bytesSaved != 0) {
+        this->ui->statusBar->showMessage(QString("Optimal encoding saved %1 bytes.").arg(bytesSaved), 5000);
+    }
 }
 
 static QString imageNameFilter()
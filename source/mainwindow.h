@@ -94,6 +94,7 @@ protected:
 
 private:
     void updateWindow();
+    void reloadConfig();
 
     void addFrames(bool append);
     void addSubtiles(bool append);
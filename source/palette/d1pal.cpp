@@ -1,8 +1,22 @@
 #include "d1pal.h"
 
+#include <atomic>
+
 #include <QDataStream>
 #include <QTextStream>
 
+namespace {
+
+// shared by every palette, so (palette, generation) pairs stay unique even if a palette is reallocated at the same address
+std::atomic<quint64> lastGeneration { 0 };
+
+} // namespace
+
+D1Pal::D1Pal()
+    : generation(++lastGeneration)
+{
+}
+
 bool D1Pal::load(QString filePath)
 {
     QFile file = QFile(filePath);
@@ -19,6 +33,7 @@ bool D1Pal::load(QString filePath)
     for (int i = 0; i < 32; i++)
         this->origCyclePalette[i] = this->colors[i];
 
+    this->colorsChanged();
     this->palFilePath = filePath;
     this->modified = false;
     return true;
@@ -137,16 +152,62 @@ QColor D1Pal::getColor(quint8 index)
 
 void D1Pal::setColor(quint8 index, QColor color)
 {
-    this->colors[index] = color;
     if (index < 32)
         this->origCyclePalette[index] = color;
     this->modified = true;
+    if (this->colors[index] == color)
+        return;
+    this->colors[index] = color;
+    this->colorsChanged();
+}
+
+void D1Pal::setColors(const QColor *colors)
+{
+    bool changed = false;
+    for (int i = 0; i < D1PAL_COLORS; i++) {
+        if (i < 32)
+            this->origCyclePalette[i] = colors[i];
+        if (this->colors[i] == colors[i])
+            continue;
+        this->colors[i] = colors[i];
+        changed = true;
+    }
+    this->modified = true;
+    if (changed)
+        this->colorsChanged();
+}
+
+void D1Pal::colorsChanged()
+{
+    this->generation = ++lastGeneration;
+}
+
+const QRgb *D1Pal::getRgbColors()
+{
+    if (this->rgbColorsGeneration != this->generation) {
+        for (int i = 0; i < D1PAL_COLORS; i++)
+            this->rgbColors[i] = this->colors[i].rgba();
+        this->rgbColorsGeneration = this->generation;
+    }
+    return this->rgbColors;
+}
+
+quint64 D1Pal::getGeneration() const
+{
+    return this->generation;
 }
 
 void D1Pal::resetColors()
 {
-    for (int i = 0; i < 32; i++)
+    bool changed = false;
+    for (int i = 0; i < 32; i++) {
+        if (this->colors[i] == this->origCyclePalette[i])
+            continue;
         this->colors[i] = this->origCyclePalette[i];
+        changed = true;
+    }
+    if (changed)
+        this->colorsChanged();
 }
 
 void D1Pal::cycleColors(D1PAL_CYCLE_TYPE type)
@@ -165,7 +226,7 @@ void D1Pal::cycleColors(D1PAL_CYCLE_TYPE type)
         break;
     case D1PAL_CYCLE_TYPE::NEST:
         if (--this->currentCycleCounter != 0)
-            break;
+            return; // nothing changed
         this->currentCycleCounter = 3;
         celColor = this->colors[8];
         for (i = 8; i > 1; i--) {
@@ -197,4 +258,5 @@ void D1Pal::cycleColors(D1PAL_CYCLE_TYPE type)
         this->colors[i] = celColor;
         break;
     }
+    this->colorsChanged();
 }
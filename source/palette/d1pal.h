@@ -28,7 +28,7 @@ public:
     static constexpr const char *DEFAULT_PATH = ":/default.pal";
     static constexpr const char *DEFAULT_NAME = "_default.pal";
 
-    D1Pal() = default;
+    D1Pal();
     ~D1Pal() override = default;
 
     virtual bool load(QString);
@@ -43,12 +43,19 @@ public:
 
     QColor getColor(quint8);
     void setColor(quint8, QColor);
+    // replace every color at once (D1PAL_COLORS entries)
+    void setColors(const QColor *colors);
+    // the colors as QRgb values, rebuilt when the palette changes
+    const QRgb *getRgbColors();
+    // process-wide unique value, renewed every time the colors change
+    quint64 getGeneration() const;
 
     void resetColors();
     void cycleColors(D1PAL_CYCLE_TYPE type);
 
 private:
     void loadRegularPalette(QFile &file);
+    void colorsChanged();
     bool loadJascPalette(QFile &file);
 
 private:
@@ -58,4 +65,8 @@ private:
     quint8 currentCycleCounter = 3;
     // buffer to store the original colors in case of color cycling
     QColor origCyclePalette[32];
+    quint64 generation;
+    // lookup table of getRgbColors
+    QRgb rgbColors[D1PAL_COLORS];
+    quint64 rgbColorsGeneration = 0; // built on first use
 };
@@ -1,5 +1,37 @@
 #include "d1palhits.h"
 
+#include <algorithm>
+
+#include <QSet>
+#include <QtConcurrent>
+
+#include "d1formats/d1rowscanner.h"
+
+namespace {
+
+void countFrameHits(const D1GfxFrame &frame, D1PalHistogram &hits)
+{
+    hits.fill(0);
+    const int width = frame.getWidth();
+    for (int y = 0; y < frame.getHeight(); y++) {
+        const quint8 *indexRow = frame.getIndexRow(y);
+        const quint8 *maskRow = frame.getMaskRow(y);
+        int x = 0;
+        while (x < width) {
+            // skip the transparent pixels and count the opaque run
+            x += D1RowScanner::transparentRunLength(maskRow, x, width);
+            if (x >= width)
+                break;
+            int run = D1RowScanner::opaqueRunLength(maskRow, x, width);
+            for (int end = x + run; x < end; x++) {
+                hits[indexRow[x]]++;
+            }
+        }
+    }
+}
+
+} // namespace
+
 D1PalHits::D1PalHits(D1Gfx *g, D1Min *m, D1Til *t)
     : gfx(g)
     , min(m)
@@ -10,9 +42,17 @@ D1PalHits::D1PalHits(D1Gfx *g, D1Min *m, D1Til *t)
 
 void D1PalHits::update()
 {
-    this->buildPalHits();
-    this->buildSubtilePalHits();
-    this->buildTilePalHits();
+    // the hits are not needed to display all colors, postpone the update to avoid decoding every frame
+    if (this->mode == D1PALHITS_MODE::ALL_COLORS) {
+        this->upToDate = false;
+        return;
+    }
+
+    std::vector<bool> changedSubtiles;
+    this->updateFramePalHits();
+    this->updateSubtilePalHits(changedSubtiles);
+    this->updateTilePalHits(changedSubtiles);
+    this->upToDate = true;
 }
 
 D1PALHITS_MODE D1PalHits::getMode() const
@@ -23,93 +63,154 @@ D1PALHITS_MODE D1PalHits::getMode() const
 void D1PalHits::setMode(D1PALHITS_MODE m)
 {
     this->mode = m;
+    if (!this->upToDate)
+        this->update();
 }
 
-void D1PalHits::buildPalHits()
+void D1PalHits::addHits(D1PalHistogram &dst, const D1PalHistogram &src)
 {
-    // Go through all frames
-    this->framePalHits.clear();
-    this->allFramesPalHits.clear();
-    for (int i = 0; i < this->gfx->getFrameCount(); i++) {
-        QMap<quint8, int> frameHits;
+    for (int i = 0; i < D1PAL_COLORS; i++) {
+        dst[i] += src[i];
+    }
+}
 
-        // Get frame pointer
-        D1GfxFrame *frame = this->gfx->getFrame(i);
+void D1PalHits::subtractHits(D1PalHistogram &dst, const D1PalHistogram &src)
+{
+    for (int i = 0; i < D1PAL_COLORS; i++) {
+        dst[i] -= src[i];
+    }
+}
 
-        // Go through every pixels of the frame
-        for (int x = 0; x < frame->getWidth(); x++) {
-            for (int y = 0; y < frame->getHeight(); y++) {
-                // Retrieve the color of the pixel
-                D1GfxPixel pixel = frame->getPixel(x, y);
-                if (pixel.isTransparent())
-                    continue;
-                quint8 paletteIndex = pixel.getPaletteIndex();
+D1PalColorSet D1PalHits::usedColors(const D1PalHistogram &hits)
+{
+    D1PalColorSet result;
+    for (int i = 0; i < D1PAL_COLORS; i++) {
+        if (hits[i] != 0)
+            result.set(i);
+    }
+    return result;
+}
 
-                // Add one hit to the frameHits and allFramesPalHits maps
-                frameHits.insert(paletteIndex, frameHits.value(paletteIndex) + 1);
+void D1PalHits::updateFramePalHits()
+{
+    // the frames are immutable, a changed frame gets a new revision
+    QList<quint64> revisions;
+    QSet<quint64> currentRevisions;
+    for (int i = 0; i < this->gfx->getFrameCount(); i++) {
+        quint64 revision = this->gfx->getFrameRevision(i);
+        revisions.append(revision);
+        currentRevisions.insert(revision);
+    }
 
-                this->allFramesPalHits.insert(paletteIndex, frameHits.value(paletteIndex) + 1);
-            }
+    // drop the hits of the removed/replaced frames
+    for (auto it = this->framePalHits.begin(); it != this->framePalHits.end();) {
+        if (!currentRevisions.contains(it.key())) {
+            subtractHits(this->allFramesPalHits, it.value().hits);
+            it = this->framePalHits.erase(it);
+        } else {
+            ++it;
         }
+    }
 
-        this->framePalHits[i] = frameHits;
+    // collect the new frames
+    std::vector<int> pendingFrames;
+    for (int i = 0; i < revisions.count(); i++) {
+        if (!this->framePalHits.contains(revisions[i]))
+            pendingFrames.push_back(i);
     }
+
+    if (!pendingFrames.empty()) {
+        // decode the frames in advance, then count their hits in parallel
+        this->gfx->decodeFrames(pendingFrames);
+        std::vector<std::pair<const D1GfxFrame *, D1PalHitsFrame *>> jobs;
+        for (int frameIndex : pendingFrames) {
+            this->framePalHits.insert(revisions[frameIndex], D1PalHitsFrame());
+        }
+        // the hash is not modified while the workers fill their own entry
+        for (int frameIndex : pendingFrames) {
+            jobs.push_back({ this->gfx->getFrame(frameIndex), &this->framePalHits[revisions[frameIndex]] });
+        }
+        QtConcurrent::blockingMap(jobs, [](const std::pair<const D1GfxFrame *, D1PalHitsFrame *> &job) {
+            countFrameHits(*job.first, job.second->hits);
+            job.second->usedColors = usedColors(job.second->hits);
+        });
+
+        for (const auto &job : jobs) {
+            addHits(this->allFramesPalHits, job.second->hits);
+        }
+    }
+    this->allFramesUsedColors = usedColors(this->allFramesPalHits);
+
+    this->frameRevisions.swap(revisions);
 }
 
-void D1PalHits::buildSubtilePalHits()
+void D1PalHits::updateSubtilePalHits(std::vector<bool> &changedSubtiles)
 {
-    this->subtilePalHits.clear();
-
     if (this->min == nullptr) {
+        this->subtilePalHits.clear();
         return;
     }
-    // Go through all sub-tiles
-    for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        QMap<quint8, int> subtileHits;
 
-        // Retrieve the CEL frame indices of the current sub-tile
-        QList<quint16> &celFrameIndices = this->min->getCelFrameIndices(i);
-
-        // Go through the CEL frames
-        for (quint16 frameIndex : celFrameIndices) {
+    int subtileCount = this->min->getSubtileCount();
+    this->subtilePalHits.resize(subtileCount);
+    changedSubtiles.assign(subtileCount, false);
+    // Go through all sub-tiles
+    for (int i = 0; i < subtileCount; i++) {
+        // Retrieve the revisions of the CEL frames of the current sub-tile
+        QList<quint64> revisions;
+        for (quint16 frameIndex : this->min->getCelFrameIndices(i)) {
             frameIndex--;
-
-            // Go through the hits of the CEL frame and add them to the subtile hits
-            QMapIterator<quint8, int> it2(this->framePalHits.value(frameIndex));
-            while (it2.hasNext()) {
-                it2.next();
-                subtileHits.insert(it2.key(), it2.value());
-            }
+            revisions.append(frameIndex < this->frameRevisions.count() ? this->frameRevisions[frameIndex] : 0);
         }
 
-        this->subtilePalHits[i] = subtileHits;
+        D1PalHitsSubtile &subtileHits = this->subtilePalHits[i];
+        if (subtileHits.frameRevisions == revisions)
+            continue;
+
+        // Sum the hits of the CEL frames
+        subtileHits.hits.fill(0);
+        for (quint64 revision : revisions) {
+            auto it = this->framePalHits.constFind(revision);
+            if (it != this->framePalHits.constEnd())
+                addHits(subtileHits.hits, it.value().hits);
+        }
+        subtileHits.usedColors = usedColors(subtileHits.hits);
+        subtileHits.frameRevisions.swap(revisions);
+        changedSubtiles[i] = true;
     }
 }
 
-void D1PalHits::buildTilePalHits()
+void D1PalHits::updateTilePalHits(const std::vector<bool> &changedSubtiles)
 {
-    this->tilePalHits.clear();
     if (this->til == nullptr) {
+        this->tilePalHits.clear();
         return;
     }
-    // Go through all tiles
-    for (int i = 0; i < this->til->getTileCount(); i++) {
-        QMap<quint8, int> tileHits;
 
+    int tileCount = this->til->getTileCount();
+    this->tilePalHits.resize(tileCount);
+    // Go through all tiles
+    for (int i = 0; i < tileCount; i++) {
         // Retrieve the sub-tile indices of the current tile
-        QList<quint16> &subtileIndices = this->til->getSubtileIndices(i);
+        const D1EntryView subtileIndices = this->til->getSubtileIndices(i);
 
-        // Go through the sub-tiles
-        for (quint16 subtileIndex : subtileIndices) {
-            // Go through the hits of the sub-tile and add them to the tile hits
-            QMapIterator<quint8, int> it2(this->subtilePalHits.value(subtileIndex));
-            while (it2.hasNext()) {
-                it2.next();
-                tileHits.insert(it2.key(), it2.value());
-            }
+        D1PalHitsTile &tileHits = this->tilePalHits[i];
+        bool changed = !std::equal(tileHits.subtileIndices.cbegin(), tileHits.subtileIndices.cend(), subtileIndices.begin(), subtileIndices.end());
+        for (int n = 0; n < (int)subtileIndices.size() && !changed; n++) {
+            quint16 subtileIndex = subtileIndices[n];
+            changed = subtileIndex < changedSubtiles.size() && changedSubtiles[subtileIndex];
         }
+        if (!changed)
+            continue;
 
-        this->tilePalHits[i] = tileHits;
+        // Sum the hits of the sub-tiles
+        tileHits.hits.fill(0);
+        for (quint16 subtileIndex : subtileIndices) {
+            if (subtileIndex < this->subtilePalHits.size())
+                addHits(tileHits.hits, this->subtilePalHits[subtileIndex].hits);
+        }
+        tileHits.usedColors = usedColors(tileHits.hits);
+        tileHits.subtileIndices.assign(subtileIndices.begin(), subtileIndices.end());
     }
 }
 
@@ -119,22 +220,46 @@ int D1PalHits::getIndexHits(quint8 colorIndex, int itemIndex) const
     case D1PALHITS_MODE::ALL_COLORS:
         return 1;
     case D1PALHITS_MODE::ALL_FRAMES:
-        if (this->allFramesPalHits.contains(colorIndex))
-            return this->allFramesPalHits[colorIndex];
-        break;
+        return this->allFramesPalHits[colorIndex];
     case D1PALHITS_MODE::CURRENT_TILE:
-        if (this->tilePalHits.contains(itemIndex) && this->tilePalHits[itemIndex].contains(colorIndex))
-            return this->tilePalHits[itemIndex][colorIndex];
+        if (itemIndex >= 0 && itemIndex < (int)this->tilePalHits.size())
+            return this->tilePalHits[itemIndex].hits[colorIndex];
         break;
     case D1PALHITS_MODE::CURRENT_SUBTILE:
-        if (this->subtilePalHits.contains(itemIndex) && this->subtilePalHits[itemIndex].contains(colorIndex))
-            return this->subtilePalHits[itemIndex][colorIndex];
+        if (itemIndex >= 0 && itemIndex < (int)this->subtilePalHits.size())
+            return this->subtilePalHits[itemIndex].hits[colorIndex];
         break;
     case D1PALHITS_MODE::CURRENT_FRAME:
-        if (this->framePalHits.contains(itemIndex) && this->framePalHits[itemIndex].contains(colorIndex))
-            return this->framePalHits[itemIndex][colorIndex];
+        if (itemIndex >= 0 && itemIndex < this->frameRevisions.count())
+            return this->framePalHits.value(this->frameRevisions[itemIndex]).hits[colorIndex];
         break;
     }
 
     return 0;
 }
+
+bool D1PalHits::isIndexUsed(quint8 colorIndex, int itemIndex) const
+{
+    switch (this->mode) {
+    case D1PALHITS_MODE::ALL_COLORS:
+        return true;
+    case D1PALHITS_MODE::ALL_FRAMES:
+        return this->allFramesUsedColors.test(colorIndex);
+    case D1PALHITS_MODE::CURRENT_TILE:
+        if (itemIndex >= 0 && itemIndex < (int)this->tilePalHits.size())
+            return this->tilePalHits[itemIndex].usedColors.test(colorIndex);
+        break;
+    case D1PALHITS_MODE::CURRENT_SUBTILE:
+        if (itemIndex >= 0 && itemIndex < (int)this->subtilePalHits.size())
+            return this->subtilePalHits[itemIndex].usedColors.test(colorIndex);
+        break;
+    case D1PALHITS_MODE::CURRENT_FRAME:
+        if (itemIndex >= 0 && itemIndex < this->frameRevisions.count()) {
+            auto it = this->framePalHits.constFind(this->frameRevisions[itemIndex]);
+            return it != this->framePalHits.constEnd() && it.value().usedColors.test(colorIndex);
+        }
+        break;
+    }
+
+    return false;
+}
@@ -1,6 +1,11 @@
 #pragma once
 
-#include <QMap>
+#include <QHash>
+#include <QList>
+
+#include <array>
+#include <bitset>
+#include <vector>
 
 #include "d1formats/d1gfx.h"
 #include "d1formats/d1min.h"
@@ -14,6 +19,31 @@ enum class D1PALHITS_MODE {
     CURRENT_FRAME
 };
 
+// Number of hits per palette index
+typedef std::array<quint32, D1PAL_COLORS> D1PalHistogram;
+// Set of the palette indices with at least one hit
+typedef std::bitset<D1PAL_COLORS> D1PalColorSet;
+
+// Hits of a frame
+struct D1PalHitsFrame {
+    D1PalHistogram hits = {};
+    D1PalColorSet usedColors;
+};
+
+// Hits of a sub-tile with the frame revisions they were summed from
+struct D1PalHitsSubtile {
+    QList<quint64> frameRevisions;
+    D1PalHistogram hits = {};
+    D1PalColorSet usedColors;
+};
+
+// Hits of a tile with the sub-tile indices they were summed from
+struct D1PalHitsTile {
+    std::vector<quint16> subtileIndices;
+    D1PalHistogram hits = {};
+    D1PalColorSet usedColors;
+};
+
 class D1PalHits : public QObject {
     Q_OBJECT
 
@@ -27,22 +57,32 @@ public:
 
     // Returns the number of hits for a specific index
     int getIndexHits(quint8 colorIndex, int itemIndex) const;
+    // Returns whether a specific index has any hits
+    bool isIndexUsed(quint8 colorIndex, int itemIndex) const;
 
 private:
-    void buildPalHits();
-    void buildSubtilePalHits();
-    void buildTilePalHits();
+    void updateFramePalHits();
+    void updateSubtilePalHits(std::vector<bool> &changedSubtiles);
+    void updateTilePalHits(const std::vector<bool> &changedSubtiles);
+
+    static void addHits(D1PalHistogram &dst, const D1PalHistogram &src);
+    static void subtractHits(D1PalHistogram &dst, const D1PalHistogram &src);
+    static D1PalColorSet usedColors(const D1PalHistogram &hits);
 
 private:
     D1PALHITS_MODE mode = D1PALHITS_MODE::ALL_COLORS;
+    bool upToDate = false;
 
     D1Gfx *gfx;
     D1Min *min;
     D1Til *til;
 
-    // Palette hits are stored with a palette index key and a hit count value
-    QMap<quint8, int> allFramesPalHits;
-    QMap<int, QMap<quint8, int>> framePalHits;
-    QMap<int, QMap<quint8, int>> tilePalHits;
-    QMap<int, QMap<quint8, int>> subtilePalHits;
+    // The hits are only recalculated for the frames, sub-tiles and tiles whose content changed since the last update
+    D1PalHistogram allFramesPalHits = {};
+    D1PalColorSet allFramesUsedColors;
+    // hits of the frames keyed by the revision of the frame
+    QHash<quint64, D1PalHitsFrame> framePalHits;
+    QList<quint64> frameRevisions;
+    std::vector<D1PalHitsSubtile> subtilePalHits;
+    std::vector<D1PalHitsTile> tilePalHits;
 };
@@ -11,12 +11,42 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QtConcurrent>
 #include <utility>
 
+#include "d1formats/d1rowscanner.h"
 #include "ui_celview.h"
 #include "undostack/framecmds.h"
 #include "undostack/undomacro.h"
 
+namespace {
+
+// render a frame on its gray background for the animation
+QImage renderAnimationFrame(const D1GfxFrame &frame, const QVector<QRgb> &colors)
+{
+    const int width = frame.getWidth();
+    QImage image = QImage(width, frame.getHeight(), QImage::Format_ARGB32);
+    image.fill(Qt::gray);
+
+    for (int y = 0; y < frame.getHeight(); y++) {
+        const quint8 *indexRow = frame.getIndexRow(y);
+        const quint8 *maskRow = frame.getMaskRow(y);
+        QRgb *destRow = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width;) {
+            x += D1RowScanner::transparentRunLength(maskRow, x, width);
+            if (x >= width)
+                break;
+            const int end = x + D1RowScanner::opaqueRunLength(maskRow, x, width);
+            for (; x < end; x++)
+                destRow[x] = colors[indexRow[x]];
+        }
+    }
+
+    return image;
+}
+
+} // namespace
+
 CelScene::CelScene(QWidget *v)
     : QGraphicsScene()
     , view(v)
@@ -107,6 +137,9 @@ CelView::CelView(std::shared_ptr<UndoStack> us, QWidget *parent)
     // If a pixel of the frame was clicked get pixel color index and notify the palette widgets
     QObject::connect(this->celScene, &CelScene::framePixelClicked, this, &CelView::framePixelClicked);
 
+    // Convert the pre-rendered frames of the animation to pixmaps (must be done in the GUI thread)
+    QObject::connect(&this->animationWatcher, &QFutureWatcher<QList<QImage>>::finished, this, &CelView::animationRendered);
+
     // setup context menu
     this->setContextMenuPolicy(Qt::CustomContextMenu);
     QObject::connect(this, SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(ShowContextMenu(const QPoint &)));
@@ -117,6 +150,7 @@ CelView::CelView(std::shared_ptr<UndoStack> us, QWidget *parent)
 
 CelView::~CelView()
 {
+    this->animationWatcher.waitForFinished();
     delete ui;
     delete celScene;
 }
@@ -124,6 +158,7 @@ CelView::~CelView()
 void CelView::initialize(D1Gfx *g)
 {
     this->gfx = g;
+    this->celFrameImageIndex = -1;
 
     // Displaying CEL file path information
     QFileInfo gfxFileInfo(this->gfx->getFilePath());
@@ -351,11 +386,31 @@ void CelView::regroupFrames(int numGroups)
 }
 
 void CelView::displayFrame()
+{
+    // Getting the current frame to display
+    this->celFrameImage = this->gfx->getFrameIndexedImage(this->currentFrameIndex);
+    this->celFrameImageIndex = this->currentFrameIndex;
+
+    this->showFrameImage();
+}
+
+void CelView::refreshPalette()
+{
+    // only the colors changed: update the color table of the rendered frame if possible
+    if (this->celFrameImageIndex != this->currentFrameIndex || !this->gfx->updateColorTable(this->celFrameImage)) {
+        this->displayFrame();
+        return;
+    }
+
+    this->showFrameImage();
+}
+
+void CelView::showFrameImage()
 {
     this->celScene->clear();
+    this->animationItem = nullptr;
 
-    // Getting the current frame to display
-    QImage celFrame = this->gfx->getFrameImage(this->currentFrameIndex);
+    const QImage &celFrame = this->celFrameImage;
     int celFrameWidth = this->gfx->getFrameWidth(this->currentFrameIndex);
     int celFrameHeight = this->gfx->getFrameHeight(this->currentFrameIndex);
 
@@ -427,25 +482,138 @@ void CelView::setGroupIndex()
 
 void CelView::playGroup()
 {
-    QPair<quint16, quint16> groupFrameIndices = this->gfx->getGroupFrameIndices(this->currentGroupIndex);
-
-    if (this->currentFrameIndex < groupFrameIndices.second)
-        this->currentFrameIndex++;
-    else
-        this->currentFrameIndex = groupFrameIndices.first;
-
-    MainWindow *mw = (MainWindow *)this->window();
-
     int cycleType = this->ui->playComboBox->currentIndex();
     if (cycleType == 0) {
         // normal playback
-        this->displayFrame();
+        QPair<quint16, quint16> groupFrameIndices = this->gfx->getGroupFrameIndices(this->currentGroupIndex);
+
+        if (this->currentFrameIndex < groupFrameIndices.second)
+            this->currentFrameIndex++;
+        else
+            this->currentFrameIndex = groupFrameIndices.first;
+
+        // use the pre-rendered frames if they are available
+        if (this->showAnimationFrame()) {
+            this->animationHits++;
+        } else {
+            this->animationMisses++;
+            this->displayFrame();
+        }
     } else {
+        // color cycling: the current frame is kept and only its color table is updated through the modified signal of the palette
+        MainWindow *mw = (MainWindow *)this->window();
         mw->nextPaletteCycle((D1PAL_CYCLE_TYPE)(cycleType - 1));
-        // this->displayFrame();
     }
 }
 
+// start rendering the frames of the current group in the background
+void CelView::prepareAnimation()
+{
+    if (this->animationWatcher.isRunning() || this->isAnimationUpToDate())
+        return;
+
+    D1Pal *palette = this->gfx->getPalette();
+    if (palette == nullptr || this->gfx->getGroupCount() == 0)
+        return;
+
+    QPair<quint16, quint16> groupFrameIndices = this->gfx->getGroupFrameIndices(this->currentGroupIndex);
+    std::vector<int> frameIndices;
+    for (int i = groupFrameIndices.first; i <= groupFrameIndices.second; i++) {
+        frameIndices.push_back(i);
+    }
+    this->gfx->decodeFrames(frameIndices);
+
+    // the workers get their own (shallow) copies of the frames and of the colors
+    QList<D1GfxFrame> frames;
+    this->animationFrameRevisions.clear();
+    for (int frameIndex : frameIndices) {
+        frames.append(*this->gfx->getFrame(frameIndex));
+        this->animationFrameRevisions.append(this->gfx->getFrameRevision(frameIndex));
+    }
+    const QRgb *rgbColors = palette->getRgbColors();
+    QVector<QRgb> colors(rgbColors, rgbColors + D1PAL_COLORS);
+
+    this->animationPixmaps.clear();
+    this->animationFirstFrameIndex = groupFrameIndices.first;
+    this->animationPalette = palette;
+    this->animationPaletteGeneration = palette->getGeneration();
+    this->animationWatcher.setFuture(QtConcurrent::run([frames, colors]() {
+        QList<QImage> images;
+        for (const D1GfxFrame &frame : frames) {
+            images.append(renderAnimationFrame(frame, colors));
+        }
+        return images;
+    }));
+}
+
+bool CelView::isAnimationUpToDate()
+{
+    if (this->animationFirstFrameIndex < 0 || this->gfx->getGroupCount() == 0)
+        return false;
+
+    QPair<quint16, quint16> groupFrameIndices = this->gfx->getGroupFrameIndices(this->currentGroupIndex);
+    if (this->animationFirstFrameIndex != groupFrameIndices.first
+        || this->animationFrameRevisions.count() != groupFrameIndices.second - groupFrameIndices.first + 1)
+        return false;
+
+    D1Pal *palette = this->gfx->getPalette();
+    if (this->animationPalette != palette || palette == nullptr || this->animationPaletteGeneration != palette->getGeneration())
+        return false;
+
+    for (int i = 0; i < this->animationFrameRevisions.count(); i++) {
+        if (this->animationFrameRevisions[i] != this->gfx->getFrameRevision(this->animationFirstFrameIndex + i))
+            return false;
+    }
+    return true;
+}
+
+void CelView::animationRendered()
+{
+    this->animationPixmaps.clear();
+    const QList<QImage> images = this->animationWatcher.result();
+    for (const QImage &image : images) {
+        this->animationPixmaps.append(QPixmap::fromImage(image));
+    }
+}
+
+// display the current frame by swapping the pixmap of the animation item
+bool CelView::showAnimationFrame()
+{
+    if (this->animationWatcher.isRunning() || !this->isAnimationUpToDate()) {
+        this->prepareAnimation();
+        return false;
+    }
+
+    int animationIndex = this->currentFrameIndex - this->animationFirstFrameIndex;
+    if (animationIndex < 0 || animationIndex >= this->animationPixmaps.count())
+        return false;
+
+    const QPixmap &pixmap = this->animationPixmaps[animationIndex];
+    if (pixmap.isNull())
+        return false;
+
+    if (this->animationItem == nullptr) {
+        this->celScene->clear();
+        this->animationItem = this->celScene->addPixmap(pixmap);
+        this->animationItem->setPos(CEL_SCENE_SPACING, CEL_SCENE_SPACING);
+    } else {
+        this->animationItem->setPixmap(pixmap);
+    }
+    this->celScene->setSceneRect(0, 0,
+        pixmap.width() + CEL_SCENE_SPACING * 2,
+        pixmap.height() + CEL_SCENE_SPACING * 2);
+    // the rendered Indexed8 image is not shown anymore
+    this->celFrameImageIndex = -1;
+
+    // Set current frame width, height and text
+    this->ui->celFrameWidthEdit->setText(QString::number(pixmap.width()) + " px");
+    this->ui->celFrameHeightEdit->setText(QString::number(pixmap.height()) + " px");
+    this->ui->frameIndexEdit->setText(QString::number(this->currentFrameIndex + 1));
+
+    // frameRefreshed is not emitted while playing, the palette widgets are refreshed once the playback stops
+    return true;
+}
+
 void CelView::ShowContextMenu(const QPoint &pos)
 {
     MainWindow *mw = (MainWindow *)this->window();
@@ -639,14 +807,25 @@ void CelView::on_playButton_clicked()
     // enable the stop button
     this->ui->stopButton->setEnabled(true);
 
+    // pre-render the frames of the group for normal playback
+    if (this->ui->playComboBox->currentIndex() == 0)
+        this->prepareAnimation();
+
+    this->animationHits = 0;
+    this->animationMisses = 0;
     this->playTimer.start(this->currentPlayDelay);
 }
 
 void CelView::on_stopButton_clicked()
 {
     this->playTimer.stop();
+    if (this->ui->playComboBox->currentIndex() == 0)
+        qDebug() << "Animation frames pre-rendered:" << this->animationHits << "rendered on the fly:" << this->animationMisses;
+    // release the pre-rendered frames
+    this->animationPixmaps.clear();
+    this->animationFirstFrameIndex = -1;
 
-    // restore palette
+    // restore palette (redisplays the current frame through refreshPalette, which refreshes the palette widgets)
     ((MainWindow *)this->window())->resetPaletteCycle();
     // disable the stop button
     this->ui->stopButton->setEnabled(false);
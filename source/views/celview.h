@@ -3,9 +3,12 @@
 #include <QContextMenuEvent>
 #include <QDragEnterEvent>
 #include <QDropEvent>
+#include <QFutureWatcher>
+#include <QGraphicsPixmapItem>
 #include <QGraphicsScene>
 #include <QGraphicsSceneDragDropEvent>
 #include <QGraphicsSceneMouseEvent>
+#include <QPixmap>
 #include <QPoint>
 #include <QStringList>
 #include <QTimer>
@@ -67,6 +70,7 @@ public:
     void updateGroupIndex();
 
     void displayFrame();
+    void refreshPalette();
     [[nodiscard]] bool isInImage(unsigned int x, unsigned int y) const;
 
 signals:
@@ -75,6 +79,11 @@ signals:
 
 private:
     void update();
+    void showFrameImage();
+    void prepareAnimation();
+    bool isAnimationUpToDate();
+    bool showAnimationFrame();
+    void animationRendered();
     void removeFrames(int index);
     void insertFrames(int index, const QImage &image);
     void setGroupIndex();
@@ -123,4 +132,20 @@ private:
     quint16 currentPlayDelay = 50;
 
     QTimer playTimer;
+
+    // the last rendered (Indexed8) image of the current frame
+    QImage celFrameImage;
+    int celFrameImageIndex = -1;
+
+    // pre-rendered frames of the played group (rendered in the background, displayed by a single item)
+    QFutureWatcher<QList<QImage>> animationWatcher;
+    QList<QPixmap> animationPixmaps;
+    QList<quint64> animationFrameRevisions;
+    int animationFirstFrameIndex = -1;
+    D1Pal *animationPalette = nullptr;
+    quint64 animationPaletteGeneration = 0;
+    QGraphicsPixmapItem *animationItem = nullptr;
+    // number of ticks shown from the pre-rendered frames / rendered on the fly during the playback
+    int animationHits = 0;
+    int animationMisses = 0;
 };
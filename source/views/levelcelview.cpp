@@ -1,9 +1,10 @@
 #include "levelcelview.h"
 
 #include <algorithm>
-#include <set>
+#include <cstring>
 
 #include "d1formats/d1image.h"
+#include "d1formats/d1rowscanner.h"
 #include "mainwindow.h"
 #include "ui_levelcelview.h"
 #include "undostack/framecmds.h"
@@ -12,6 +13,7 @@
 #include <QDebug>
 #include <QFileInfo>
 #include <QGraphicsPixmapItem>
+#include <QHash>
 #include <QImageReader>
 #include <QMenu>
 #include <QMessageBox>
@@ -20,6 +22,35 @@
 
 namespace {
 
+// the visible pixels are detected by the top bit of the alpha channel
+static_assert(COLOR_ALPHA_LIMIT == 128);
+
+/**
+ * @brief Copies an area of an ARGB32 image to subImage
+ *
+ * The parts of the area outside of the image are transparent.
+ *
+ * @return Returns whether the area has a visible pixel
+ */
+bool copyImageArea(const QImage &image, int x, int y, QImage &subImage)
+{
+    quint32 pixelBits = 0;
+    const int width = subImage.width();
+    const int copyWidth = std::max(0, std::min(width, image.width() - x));
+    for (int j = 0; j < subImage.height(); j++) {
+        QRgb *destRow = reinterpret_cast<QRgb *>(subImage.scanLine(j));
+        int copied = 0;
+        if (y + j < image.height() && copyWidth != 0) {
+            const QRgb *srcRow = reinterpret_cast<const QRgb *>(image.constScanLine(y + j)) + x;
+            memcpy(destRow, srcRow, copyWidth * sizeof(QRgb));
+            pixelBits |= D1RowScanner::orPixels(srcRow, copyWidth);
+            copied = copyWidth;
+        }
+        std::fill(destRow + copied, destRow + width, qRgba(0, 0, 0, 0));
+    }
+    return qAlpha(pixelBits) >= COLOR_ALPHA_LIMIT;
+}
+
 int getClickedSubtile(unsigned x, unsigned y, unsigned width, unsigned height)
 {
     //   |   |
@@ -79,20 +110,11 @@ QList<quint16> extractSubImages(const QImage &image, std::vector<QImage> &images
     QList<quint16> frameIndicesList;
 
     // TODO: merge with LevelCelView::insertSubtile ?
+    const QImage srcImage = image.convertToFormat(QImage::Format_ARGB32);
     QImage subImage = QImage(MICRO_WIDTH, MICRO_HEIGHT, QImage::Format_ARGB32);
-    for (int y = 0; y < image.height(); y += MICRO_HEIGHT) {
-        for (int x = 0; x < image.width(); x += MICRO_WIDTH) {
-
-            bool hasColor = false;
-            for (int j = 0; j < MICRO_HEIGHT; j++) {
-                for (int i = 0; i < MICRO_WIDTH; i++) {
-                    const QColor color = image.pixelColor(x + i, y + j);
-                    if (color.alpha() >= COLOR_ALPHA_LIMIT) {
-                        hasColor = true;
-                    }
-                    subImage.setPixelColor(i, j, color);
-                }
-            }
+    for (int y = 0; y < srcImage.height(); y += MICRO_HEIGHT) {
+        for (int x = 0; x < srcImage.width(); x += MICRO_WIDTH) {
+            bool hasColor = copyImageArea(srcImage, x, y, subImage);
             frameIndicesList.append(hasColor ? frameIndex + 1 : 0);
             if (!hasColor) {
                 continue;
@@ -260,8 +282,8 @@ void LevelCelView::framePixelClicked(unsigned x, unsigned y)
 
         int stFrame = (sty / MICRO_HEIGHT) * TILE_WIDTH + (stx / MICRO_WIDTH);
         this->editIndex = stFrame;
-        QList<quint16> &minFrames = this->min->getCelFrameIndices(this->currentSubtileIndex);
-        quint16 frameIndex = minFrames.count() > stFrame ? minFrames.at(stFrame) : 0;
+        const D1EntryView minFrames = this->min->getCelFrameIndices(this->currentSubtileIndex);
+        quint16 frameIndex = (int)minFrames.size() > stFrame ? minFrames[stFrame] : 0;
 
         if (frameIndex > 0) {
             this->currentFrameIndex = frameIndex - 1;
@@ -279,9 +301,9 @@ void LevelCelView::framePixelClicked(unsigned x, unsigned y)
 
         this->editIndex = getClickedSubtile(tx, ty, tileWidth, tileHeight);
 
-        QList<quint16> &tilSubtiles = this->til->getSubtileIndices(this->currentTileIndex);
-        if (tilSubtiles.count() > this->editIndex) {
-            this->currentSubtileIndex = tilSubtiles.at(this->editIndex);
+        const D1EntryView tilSubtiles = this->til->getSubtileIndices(this->currentTileIndex);
+        if ((int)tilSubtiles.size() > this->editIndex) {
+            this->currentSubtileIndex = tilSubtiles[this->editIndex];
             this->displayFrame();
         }
         break;
@@ -323,17 +345,8 @@ void LevelCelView::insertFrames(int index, const QImage &image)
     // Otherwise, if we are appending - just update currentFrameIndex to the one first
     // appended frame
     if (index + 1 != this->gfx->getFrameCount()) {
-        // shift references
-        unsigned refIndex = index + 1;
-        // shift frame indices of the subtiles
-        for (int i = 0; i < this->min->getSubtileCount(); i++) {
-            QList<quint16> &frameIndices = this->min->getCelFrameIndices(i);
-            for (int n = 0; n < frameIndices.count(); n++) {
-                if (frameIndices[n] >= refIndex) {
-                    frameIndices[n] += deltaFrameCount;
-                }
-            }
-        }
+        // shift the frame references of the subtiles
+        this->min->remapFrameReferences(D1Remap::shiftedIndices(prevFrameCount, index, deltaFrameCount));
     } else {
         this->currentFrameIndex = prevFrameCount;
     }
@@ -343,8 +356,7 @@ void LevelCelView::insertFrames(int index, const QImage &image)
     if (!tilesAndFramesIdxStack.empty()) {
         auto &vec = tilesAndFramesIdxStack.top();
         for (auto &pair : vec) {
-            QList<quint16> &frameIndices = this->min->getCelFrameIndices(pair.first);
-            frameIndices[pair.second] = index + 1;
+            this->min->setCelFrameIndex(pair.first, pair.second, index + 1);
         }
 
         tilesAndFramesIdxStack.pop();
@@ -494,24 +506,15 @@ void LevelCelView::insertFrame(int index, const QImage image)
         return; // no new frame -> done
     }
 
-    // FIXME: put that under some method in D1Min class
-    // shift every frame index after added index to the right
-    for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        QList<quint16> &frameIndices = this->min->getCelFrameIndices(i);
-        for (int n = 0; n < frameIndices.count(); n++) {
-            if (frameIndices[n] > index) {
-                frameIndices[n] += 1;
-            }
-        }
-    }
+    // shift every frame reference after added index to the right
+    this->min->remapFrameReferences(D1Remap::shiftedIndices(prevFrameCount, index, deltaFrameCount));
 
     // Restore frame index that was previously deleted in the tile. Index to frame list of the tile is held
     // in the .first member of pair, and .second member holds index of the logical list which holds frame indices
     // that make up the tile
     auto &vec = tilesAndFramesIdxStack.top();
     for (auto &pair : vec) {
-        QList<quint16> &frameIndices = this->min->getCelFrameIndices(pair.first);
-        frameIndices[pair.second] = index + 1;
+        this->min->setCelFrameIndex(pair.first, pair.second, index + 1);
     }
 
     tilesAndFramesIdxStack.pop();
@@ -523,33 +526,24 @@ void LevelCelView::insertFrame(int index, const QImage image)
 
 void LevelCelView::assignSubtiles(const QImage &image, int tileIndex, int subtileIndex)
 {
-    QList<quint16> *subtileIndices = nullptr;
+    D1EntryView subtileIndices;
     if (tileIndex >= 0) {
-        subtileIndices = &this->til->getSubtileIndices(tileIndex);
-        subtileIndices->clear();
+        subtileIndices = this->til->getSubtileIndices(tileIndex);
     }
+    int n = 0;
     // TODO: merge with LevelCelView::insertTile ?
     unsigned subtileWidth = this->min->getSubtileWidth() * MICRO_WIDTH;
     unsigned subtileHeight = this->min->getSubtileHeight() * MICRO_HEIGHT;
 
+    const QImage srcImage = image.convertToFormat(QImage::Format_ARGB32);
     QImage subImage = QImage(subtileWidth, subtileHeight, QImage::Format_ARGB32);
-    for (int y = 0; y < image.height(); y += subtileHeight) {
-        for (int x = 0; x < image.width(); x += subtileWidth) {
-            // subImage.fill(Qt::transparent);
-
-            bool hasColor = false;
-            for (unsigned j = 0; j < subtileHeight; j++) {
-                for (unsigned i = 0; i < subtileWidth; i++) {
-                    const QColor color = image.pixelColor(x + i, y + j);
-                    if (color.alpha() >= COLOR_ALPHA_LIMIT) {
-                        hasColor = true;
-                    }
-                    subImage.setPixelColor(i, j, color);
-                }
-            }
+    for (int y = 0; y < srcImage.height(); y += subtileHeight) {
+        for (int x = 0; x < srcImage.width(); x += subtileWidth) {
+            bool hasColor = copyImageArea(srcImage, x, y, subImage);
 
-            if (subtileIndices != nullptr) {
-                subtileIndices->append(subtileIndex);
+            if (tileIndex >= 0) {
+                if (n < (int)subtileIndices.size())
+                    this->til->setSubtileIndex(tileIndex, n++, subtileIndex);
             } else if (!hasColor) {
                 continue;
             }
@@ -632,17 +626,8 @@ void LevelCelView::insertSubtiles(IMAGE_FILE_MODE mode, const QStringList &image
         if (deltaSubtileCount == 0) {
             return; // no new subtile -> done
         }
-        // shift references
-        unsigned refIndex = this->currentSubtileIndex;
-        // shift subtile indices of the tiles
-        for (int i = 0; i < this->til->getTileCount(); i++) {
-            QList<quint16> &subtileIndices = this->til->getSubtileIndices(i);
-            for (int n = 0; n < subtileIndices.count(); n++) {
-                if (subtileIndices[n] >= refIndex) {
-                    subtileIndices[n] += deltaSubtileCount;
-                }
-            }
-        }
+        // shift the subtile references of the tiles
+        this->til->remapSubtileReferences(D1Remap::shiftedIndices(prevSubtileCount, this->currentSubtileIndex, deltaSubtileCount));
     }
     // update the view
     this->update();
@@ -654,21 +639,11 @@ void LevelCelView::insertSubtile(int subtileIndex, const QImage &image)
     QList<quint16> frameIndicesList;
 
     int frameIndex = this->gfx->getFrameCount();
+    const QImage srcImage = image.convertToFormat(QImage::Format_ARGB32);
     QImage subImage = QImage(MICRO_WIDTH, MICRO_HEIGHT, QImage::Format_ARGB32);
-    for (int y = 0; y < image.height(); y += MICRO_HEIGHT) {
-        for (int x = 0; x < image.width(); x += MICRO_WIDTH) {
-            // subImage.fill(Qt::transparent);
-
-            bool hasColor = false;
-            for (int j = 0; j < MICRO_HEIGHT; j++) {
-                for (int i = 0; i < MICRO_WIDTH; i++) {
-                    const QColor color = image.pixelColor(x + i, y + j);
-                    if (color.alpha() >= COLOR_ALPHA_LIMIT) {
-                        hasColor = true;
-                    }
-                    subImage.setPixelColor(i, j, color);
-                }
-            }
+    for (int y = 0; y < srcImage.height(); y += MICRO_HEIGHT) {
+        for (int x = 0; x < srcImage.width(); x += MICRO_WIDTH) {
+            bool hasColor = copyImageArea(srcImage, x, y, subImage);
 
             frameIndicesList.append(hasColor ? frameIndex + 1 : 0);
 
@@ -691,21 +666,11 @@ void LevelCelView::insertTile(int tileIndex, const QImage &image)
     unsigned subtileWidth = this->min->getSubtileWidth() * MICRO_WIDTH;
     unsigned subtileHeight = this->min->getSubtileHeight() * MICRO_HEIGHT;
 
+    const QImage srcImage = image.convertToFormat(QImage::Format_ARGB32);
     QImage subImage = QImage(subtileWidth, subtileHeight, QImage::Format_ARGB32);
-    for (int y = 0; y < image.height(); y += subtileHeight) {
-        for (int x = 0; x < image.width(); x += subtileWidth) {
-            // subImage.fill(Qt::transparent);
-
-            // bool hasColor = false;
-            for (unsigned j = 0; j < subtileHeight; j++) {
-                for (unsigned i = 0; i < subtileWidth; i++) {
-                    const QColor color = image.pixelColor(x + i, y + j);
-                    // if (color.alpha() >= COLOR_ALPHA_LIMIT) {
-                    //    hasColor = true;
-                    // }
-                    subImage.setPixelColor(i, j, color);
-                }
-            }
+    for (int y = 0; y < srcImage.height(); y += subtileHeight) {
+        for (int x = 0; x < srcImage.width(); x += subtileWidth) {
+            copyImageArea(srcImage, x, y, subImage);
 
             int index = this->min->getSubtileCount();
             subtileIndices.append(index);
@@ -732,21 +697,11 @@ void LevelCelView::insertTiles(IMAGE_FILE_MODE mode, int index, const QImage &im
         return;
     }
 
+    const QImage srcImage = image.convertToFormat(QImage::Format_ARGB32);
     QImage subImage = QImage(tileWidth, tileHeight, QImage::Format_ARGB32);
-    for (int y = 0; y < image.height(); y += tileHeight) {
-        for (int x = 0; x < image.width(); x += tileWidth) {
-            // subImage.fill(Qt::transparent);
-
-            bool hasColor = false;
-            for (unsigned j = 0; j < tileHeight; j++) {
-                for (unsigned i = 0; i < tileWidth; i++) {
-                    const QColor color = image.pixelColor(x + i, y + j);
-                    if (color.alpha() >= COLOR_ALPHA_LIMIT) {
-                        hasColor = true;
-                    }
-                    subImage.setPixelColor(i, j, color);
-                }
-            }
+    for (int y = 0; y < srcImage.height(); y += tileHeight) {
+        for (int x = 0; x < srcImage.width(); x += tileWidth) {
+            bool hasColor = copyImageArea(srcImage, x, y, subImage);
 
             if (!hasColor) {
                 continue;
@@ -834,6 +789,8 @@ void LevelCelView::replaceCurrentFrame(int frameIdx, const QImage &image)
     D1GfxFrame *frame = this->gfx->replaceFrame(frameIdx, image);
 
     if (frame != nullptr) {
+        // drop the cached subtiles and tiles which use the frame
+        this->til->invalidateFrame(frameIdx);
         LevelTabFrameWidget::selectFrameType(frame);
         // update the view
         this->initialize(this->gfx, this->min, this->til, this->sol, this->amp);
@@ -852,26 +809,22 @@ void LevelCelView::removeFrame(int frameIndex)
 
     tilesAndFramesIdxStack.push(std::vector<std::pair<int, int>>());
 
-    // shift references
-    // - shift frame indices of the subtiles
-    for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        QList<quint16> &frameIndices = this->min->getCelFrameIndices(i);
-        for (int n = 0; n < frameIndices.count(); n++) {
-            if (frameIndices[n] >= refIndex) {
-                if (frameIndices[n] == refIndex) {
-                    // store tile index + frame indices list index, so it can get restored
-                    // if user does undo on the remove operation, note: we have to use std::vector
-                    // here, since 1 frame could be held in multiple tiles instances
-                    auto &vec = tilesAndFramesIdxStack.top();
-                    vec.emplace_back(std::make_pair(i, n));
-
-                    frameIndices[n] = 0;
-                } else {
-                    frameIndices[n] -= 1;
-                }
+    // store tile index + frame indices list index, so it can get restored
+    // if user does undo on the remove operation, note: we have to use std::vector
+    // here, since 1 frame could be held in multiple tiles instances
+    auto &vec = tilesAndFramesIdxStack.top();
+    for (int i : this->min->getFrameUsers(frameIndex)) {
+        const D1EntryView frameIndices = this->min->getCelFrameIndices(i);
+        for (int n = 0; n < (int)frameIndices.size(); n++) {
+            if (frameIndices[n] == refIndex) {
+                vec.emplace_back(std::make_pair(i, n));
             }
         }
     }
+
+    // shift references
+    // - clear the references to the removed frame and shift the frame indices of the subtiles
+    this->min->remapFrameReferences(D1Remap::shiftedIndices(this->gfx->getFrameCount() + 1, frameIndex, -1));
 }
 
 void LevelCelView::sendRemoveFrameCmd()
@@ -928,7 +881,8 @@ void LevelCelView::cloneSubtile()
 {
     int cloneFrom = this->currentSubtileIndex;
     this->createSubtile();
-    this->min->getCelFrameIndices(this->currentSubtileIndex) = this->min->getCelFrameIndices(cloneFrom);
+    const D1EntryView frameIndices = this->min->getCelFrameIndices(cloneFrom);
+    this->min->setCelFrameIndices(this->currentSubtileIndex, QList<quint16>(frameIndices.begin(), frameIndices.end()));
     this->displayFrame();
 }
 
@@ -963,7 +917,8 @@ void LevelCelView::replaceCurrentSubtile(const QString &imagefilePath)
         frameIndex++;
     }
 
-    this->min->getCelFrameIndices(subtileIndex).swap(frameIndicesList);
+    this->min->setCelFrameIndices(subtileIndex, frameIndicesList);
+    this->til->invalidateSubtile(subtileIndex);
 
     // update the view
     this->update();
@@ -979,17 +934,8 @@ void LevelCelView::removeSubtile(int subtileIndex)
         this->currentSubtileIndex = std::max(0, this->currentSubtileIndex - 1);
     }
     // shift references
-    // - shift subtile indices of the tiles
-    unsigned refIndex = subtileIndex;
-    for (int i = 0; i < this->til->getTileCount(); i++) {
-        QList<quint16> &subtileIndices = this->til->getSubtileIndices(i);
-        for (int n = 0; n < subtileIndices.count(); n++) {
-            if (subtileIndices[n] >= refIndex) {
-                // assert(subtileIndices[n] != refIndex);
-                subtileIndices[n] -= 1;
-            }
-        }
-    }
+    // - shift subtile indices of the tiles (the removed subtile is not used)
+    this->til->remapSubtileReferences(D1Remap::shiftedIndices(this->min->getSubtileCount() + 1, subtileIndex, -1));
 }
 
 void LevelCelView::removeCurrentSubtile()
@@ -1025,7 +971,8 @@ void LevelCelView::cloneTile()
 {
     int cloneFrom = this->currentTileIndex;
     this->createTile();
-    this->til->getSubtileIndices(this->currentTileIndex) = this->til->getSubtileIndices(cloneFrom);
+    const D1EntryView subtileIndices = this->til->getSubtileIndices(cloneFrom);
+    this->til->setSubtileIndices(this->currentTileIndex, QList<quint16>(subtileIndices.begin(), subtileIndices.end()));
     this->displayFrame();
 }
 
@@ -1072,30 +1019,12 @@ void LevelCelView::removeCurrentTile()
 
 void LevelCelView::collectFrameUsers(int frameIndex, QList<int> &users) const
 {
-    unsigned refIndex = frameIndex + 1;
-
-    for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        const QList<quint16> &frameIndices = this->min->getCelFrameIndices(i);
-        for (quint16 index : frameIndices) {
-            if (index == refIndex) {
-                users.append(i);
-                break;
-            }
-        }
-    }
+    users.append(this->min->getFrameUsers(frameIndex));
 }
 
 void LevelCelView::collectSubtileUsers(int subtileIndex, QList<int> &users) const
 {
-    for (int i = 0; i < this->til->getTileCount(); i++) {
-        const QList<quint16> &subtileIndices = this->til->getSubtileIndices(i);
-        for (quint16 index : subtileIndices) {
-            if (index == subtileIndex) {
-                users.append(i);
-                break;
-            }
-        }
-    }
+    users.append(this->til->getSubtileUsers(subtileIndex));
 }
 
 void LevelCelView::reportUsage()
@@ -1206,31 +1135,38 @@ void LevelCelView::resetFrameTypes()
 void LevelCelView::removeUnusedFrames(QString &report)
 {
     // collect every frame uses
-    QList<bool> frameUsed;
-    for (int i = 0; i < this->gfx->getFrameCount(); i++) {
-        frameUsed.append(false);
-    }
+    const int frameCount = this->gfx->getFrameCount();
+    std::vector<bool> frameUsed(frameCount);
     for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        const QList<quint16> &frameIndices = this->min->getCelFrameIndices(i);
+        const D1EntryView frameIndices = this->min->getCelFrameIndices(i);
         for (quint16 frameRef : frameIndices) {
-            if (frameRef != 0) {
+            if (frameRef != 0 && frameRef <= frameCount) {
                 frameUsed[frameRef - 1] = true;
             }
         }
     }
     // remove the unused frames
     QList<int> frameRemoved;
-    for (int i = this->gfx->getFrameCount() - 1; i >= 0; i--) {
-        if (!frameUsed[i]) {
+    D1IndexRemap frameRemap(frameCount);
+    int idx = 0;
+    for (int i = 0; i < frameCount; i++) {
+        if (frameUsed[i]) {
+            frameRemap[i] = idx;
+            idx++;
+        } else {
+            frameRemap[i] = -1;
             frameRemoved.append(i);
-            this->removeFrame(i);
         }
     }
     if (frameRemoved.isEmpty()) {
         return;
     }
+    this->min->remapFrameReferences(frameRemap);
+    this->gfx->remapFrames(frameRemap);
+    this->currentFrameIndex = std::max(0, std::min(this->currentFrameIndex, this->gfx->getFrameCount() - 1));
+
     report = "Removed frame ";
-    for (auto iter = frameRemoved.crbegin(); iter != frameRemoved.crend(); ++iter) {
+    for (auto iter = frameRemoved.cbegin(); iter != frameRemoved.cend(); ++iter) {
         report += QString::number(*iter + 1) + ", ";
     }
     report.chop(2);
@@ -1240,29 +1176,39 @@ void LevelCelView::removeUnusedFrames(QString &report)
 void LevelCelView::removeUnusedSubtiles(QString &report)
 {
     // collect every subtile uses
-    QList<bool> subtileUsed;
-    for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        subtileUsed.append(false);
-    }
+    const int subtileCount = this->min->getSubtileCount();
+    std::vector<bool> subtileUsed(subtileCount);
     for (int i = 0; i < this->til->getTileCount(); i++) {
-        const QList<quint16> &subtileIndices = this->til->getSubtileIndices(i);
+        const D1EntryView subtileIndices = this->til->getSubtileIndices(i);
         for (quint16 subtileIndex : subtileIndices) {
-            subtileUsed[subtileIndex] = true;
+            if (subtileIndex < subtileCount) {
+                subtileUsed[subtileIndex] = true;
+            }
         }
     }
     // remove the unused subtiles
     QList<int> subtileRemoved;
-    for (int i = this->min->getSubtileCount() - 1; i >= 0; i--) {
-        if (!subtileUsed[i]) {
+    D1IndexRemap subtileRemap(subtileCount);
+    int idx = 0;
+    for (int i = 0; i < subtileCount; i++) {
+        if (subtileUsed[i]) {
+            subtileRemap[i] = idx;
+            idx++;
+        } else {
+            subtileRemap[i] = -1;
             subtileRemoved.append(i);
-            this->removeSubtile(i);
         }
     }
     if (subtileRemoved.isEmpty()) {
         return;
     }
+    this->til->remapSubtileReferences(subtileRemap);
+    this->min->remapSubtiles(subtileRemap);
+    this->sol->remapSubtiles(subtileRemap);
+    this->currentSubtileIndex = std::max(0, std::min(this->currentSubtileIndex, this->min->getSubtileCount() - 1));
+
     report = "Removed subtile ";
-    for (auto iter = subtileRemoved.crbegin(); iter != subtileRemoved.crend(); ++iter) {
+    for (auto iter = subtileRemoved.cbegin(); iter != subtileRemoved.cend(); ++iter) {
         report += QString::number(*iter + 1) + ", ";
     }
     report.chop(2);
@@ -1328,62 +1274,27 @@ void LevelCelView::cleanupTileset()
 void LevelCelView::reuseFrames(QString &report)
 {
     QList<QPair<int, int>> frameRemoved;
-    std::set<int> removedIndices;
 
-    for (int i = 0; i < this->gfx->getFrameCount(); i++) {
-        for (int j = i + 1; j < this->gfx->getFrameCount(); j++) {
-            D1GfxFrame *frame0 = this->gfx->getFrame(i);
-            D1GfxFrame *frame1 = this->gfx->getFrame(j);
-            int width = frame0->getWidth();
-            int height = frame0->getHeight();
-            if (width != frame1->getWidth() || height != frame1->getHeight()) {
-                continue; // should not happen, but better safe than sorry
-            }
-            bool match = true;
-            for (int y = 0; y < height && match; y++) {
-                for (int x = 0; x < width; x++) {
-                    if (frame0->getPixel(x, y) == frame1->getPixel(x, y)) {
-                        continue;
-                    }
-                    match = false;
-                    break;
-                }
-            }
-            if (!match) {
-                continue;
-            }
-            // reuse frame0 instead of frame1
-            const unsigned refIndex = j + 1;
-            for (int n = 0; n < this->min->getSubtileCount(); n++) {
-                QList<quint16> &frameIndices = this->min->getCelFrameIndices(n);
-                for (auto iter = frameIndices.begin(); iter != frameIndices.end(); iter++) {
-                    if (*iter == refIndex) {
-                        *iter = i + 1;
-                    }
-                }
-            }
-            // eliminate frame1
-            this->removeFrame(j);
-            // calculate the original indices
-            int originalIndexI = i;
-            for (auto iter = removedIndices.cbegin(); iter != removedIndices.cend(); ++iter) {
-                if (*iter <= originalIndexI) {
-                    originalIndexI++;
-                    continue;
-                }
+    // group the frames by the hash of their content and map each duplicate to the first equal frame
+    const int frameCount = this->gfx->getFrameCount();
+    this->gfx->decodeAllFrames();
+    QHash<quint64, QList<int>> framesByHash;
+    std::vector<int> frameMap(frameCount);
+    for (int i = 0; i < frameCount; i++) {
+        const D1GfxFrame *frame = this->gfx->getFrame(i);
+        QList<int> &candidates = framesByHash[frame->getContentHash()];
+        frameMap[i] = i;
+        for (int j : candidates) {
+            // compare the pixels in case of a hash collision
+            if (frame->pixelsEqual(*this->gfx->getFrame(j))) {
+                frameMap[i] = j;
                 break;
             }
-            int originalIndexJ = j;
-            for (auto iter = removedIndices.cbegin(); iter != removedIndices.cend(); ++iter) {
-                if (*iter <= originalIndexJ) {
-                    originalIndexJ++;
-                    continue;
-                }
-                break;
-            }
-            removedIndices.insert(originalIndexJ);
-            frameRemoved.append(qMakePair(originalIndexI, originalIndexJ));
-            j--;
+        }
+        if (frameMap[i] == i) {
+            candidates.append(i);
+        } else {
+            frameRemoved.append(qMakePair(frameMap[i], i));
         }
     }
 
@@ -1391,6 +1302,23 @@ void LevelCelView::reuseFrames(QString &report)
         return;
     }
 
+    // remap the frame references of the subtiles and eliminate the duplicates at once
+    D1IndexRemap frameRemap(frameCount);
+    int idx = 0;
+    for (int i = 0; i < frameCount; i++) {
+        frameRemap[i] = frameMap[i] == i ? idx++ : -1;
+    }
+    D1IndexRemap refRemap(frameCount);
+    for (int i = 0; i < frameCount; i++) {
+        refRemap[i] = frameRemap[frameMap[i]];
+    }
+    this->min->remapFrameReferences(refRemap);
+    this->gfx->remapFrames(frameRemap);
+    this->currentFrameIndex = std::max(0, std::min(this->currentFrameIndex, this->gfx->getFrameCount() - 1));
+
+    // report the frames in the order of the reused ones
+    std::sort(frameRemoved.begin(), frameRemoved.end());
+
     report = "Using frame ";
     for (auto iter = frameRemoved.cbegin(); iter != frameRemoved.cend(); ++iter) {
         report += QString::number(iter->first + 1) + " instead of " + QString::number(iter->second + 1) + ", ";
@@ -1402,58 +1330,24 @@ void LevelCelView::reuseFrames(QString &report)
 void LevelCelView::reuseSubtiles(QString &report)
 {
     QList<QPair<int, int>> subtileRemoved;
-    std::set<int> removedIndices;
 
-    for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        for (int j = i + 1; j < this->min->getSubtileCount(); j++) {
-            QList<quint16> &frameIndices0 = this->min->getCelFrameIndices(i);
-            QList<quint16> &frameIndices1 = this->min->getCelFrameIndices(j);
-            if (frameIndices0.count() != frameIndices1.count()) {
-                continue; // should not happen, but better safe than sorry
-            }
-            bool match = true;
-            for (int x = 0; x < frameIndices0.count(); x++) {
-                if (frameIndices0[x] == frameIndices1[x]) {
-                    continue;
-                }
-                match = false;
-                break;
-            }
-            if (!match) {
-                continue;
-            }
-            // use subtile 'i' instead of subtile 'j'
-            const unsigned refIndex = j;
-            for (int n = 0; n < this->til->getTileCount(); n++) {
-                QList<quint16> &subtileIndices = this->til->getSubtileIndices(n);
-                for (auto iter = subtileIndices.begin(); iter != subtileIndices.end(); iter++) {
-                    if (*iter == refIndex) {
-                        *iter = i;
-                    }
-                }
-            }
-            // eliminate subtile 'j'
-            this->removeSubtile(j);
-            // calculate the original indices
-            int originalIndexI = i;
-            for (auto iter = removedIndices.cbegin(); iter != removedIndices.cend(); ++iter) {
-                if (*iter <= originalIndexI) {
-                    originalIndexI++;
-                    continue;
-                }
-                break;
-            }
-            int originalIndexJ = j;
-            for (auto iter = removedIndices.cbegin(); iter != removedIndices.cend(); ++iter) {
-                if (*iter <= originalIndexJ) {
-                    originalIndexJ++;
-                    continue;
-                }
-                break;
-            }
-            removedIndices.insert(originalIndexJ);
-            subtileRemoved.append(qMakePair(originalIndexI, originalIndexJ));
-            j--;
+    // map each duplicate to the first subtile with the same frames and SOL flags
+    const int subtileCount = this->min->getSubtileCount();
+    QHash<QList<quint16>, int> subtileKeys;
+    std::vector<int> subtileMap(subtileCount);
+    for (int i = 0; i < subtileCount; i++) {
+        QList<quint16> key;
+        for (quint16 frameRef : this->min->getCelFrameIndices(i)) {
+            key.append(frameRef);
+        }
+        key.append(this->sol->getSubtileProperties(i));
+        auto it = subtileKeys.constFind(key);
+        if (it != subtileKeys.constEnd()) {
+            subtileMap[i] = it.value();
+            subtileRemoved.append(qMakePair(it.value(), i));
+        } else {
+            subtileKeys.insert(key, i);
+            subtileMap[i] = i;
         }
     }
 
@@ -1461,6 +1355,24 @@ void LevelCelView::reuseSubtiles(QString &report)
         return;
     }
 
+    // remap the subtile references of the tiles and eliminate the duplicates at once
+    D1IndexRemap subtileRemap(subtileCount);
+    int idx = 0;
+    for (int i = 0; i < subtileCount; i++) {
+        subtileRemap[i] = subtileMap[i] == i ? idx++ : -1;
+    }
+    D1IndexRemap refRemap(subtileCount);
+    for (int i = 0; i < subtileCount; i++) {
+        refRemap[i] = subtileRemap[subtileMap[i]];
+    }
+    this->til->remapSubtileReferences(refRemap);
+    this->min->remapSubtiles(subtileRemap);
+    this->sol->remapSubtiles(subtileRemap);
+    this->currentSubtileIndex = std::max(0, std::min(this->currentSubtileIndex, this->min->getSubtileCount() - 1));
+
+    // report the subtiles in the order of the reused ones
+    std::sort(subtileRemoved.begin(), subtileRemoved.end());
+
     report = "Using subtile ";
     for (auto iter = subtileRemoved.cbegin(); iter != subtileRemoved.cend(); ++iter) {
         report += QString::number(iter->first + 1) + " instead of " + QString::number(iter->second + 1) + ", ";
@@ -1469,6 +1381,52 @@ void LevelCelView::reuseSubtiles(QString &report)
     report += ".";
 }
 
+void LevelCelView::reuseTiles(QString &report)
+{
+    QList<QPair<int, int>> tileRemoved;
+
+    // map each duplicate to the first tile with the same subtiles and AMP type/flags
+    const int tileCount = this->til->getTileCount();
+    QHash<QList<quint16>, int> tileKeys;
+    D1IndexRemap tileRemap(tileCount);
+    int idx = 0;
+    for (int i = 0; i < tileCount; i++) {
+        QList<quint16> key;
+        for (quint16 subtileRef : this->til->getSubtileIndices(i)) {
+            key.append(subtileRef);
+        }
+        key.append(this->amp->getTileType(i));
+        key.append(this->amp->getTileProperties(i));
+        auto it = tileKeys.constFind(key);
+        if (it != tileKeys.constEnd()) {
+            tileRemap[i] = -1;
+            tileRemoved.append(qMakePair(it.value(), i));
+        } else {
+            tileKeys.insert(key, i);
+            tileRemap[i] = idx++;
+        }
+    }
+
+    if (tileRemoved.isEmpty()) {
+        return;
+    }
+
+    // eliminate the duplicates at once (the tiles are not referenced by the tileset)
+    this->til->remapTiles(tileRemap);
+    this->amp->remapTiles(tileRemap);
+    this->currentTileIndex = std::max(0, std::min(this->currentTileIndex, this->til->getTileCount() - 1));
+
+    // report the tiles in the order of the reused ones
+    std::sort(tileRemoved.begin(), tileRemoved.end());
+
+    report = "Using tile ";
+    for (auto iter = tileRemoved.cbegin(); iter != tileRemoved.cend(); ++iter) {
+        report += QString::number(iter->first + 1) + " instead of " + QString::number(iter->second + 1) + ", ";
+    }
+    report.chop(2);
+    report += ".";
+}
+
 void LevelCelView::compressTileset()
 {
     QString framesReport;
@@ -1477,8 +1435,11 @@ void LevelCelView::compressTileset()
     QString subtilesReport;
     this->reuseSubtiles(subtilesReport);
 
-    if (framesReport.isEmpty() && subtilesReport.isEmpty()) {
-        framesReport = "Every subtile and frame are unique.";
+    QString tilesReport;
+    this->reuseTiles(tilesReport);
+
+    if (framesReport.isEmpty() && subtilesReport.isEmpty() && tilesReport.isEmpty()) {
+        framesReport = "Every tile, subtile and frame are unique.";
     } else {
         // update the view
         this->update();
@@ -1490,6 +1451,12 @@ void LevelCelView::compressTileset()
             }
             framesReport += subtilesReport;
         }
+        if (!tilesReport.isEmpty()) {
+            if (!framesReport.isEmpty()) {
+                framesReport += "\n\n";
+            }
+            framesReport += tilesReport;
+        }
     }
 
     QMessageBox::information(this, "Information", framesReport);
@@ -1497,61 +1464,52 @@ void LevelCelView::compressTileset()
 
 bool LevelCelView::sortFrames_impl()
 {
-    QMap<unsigned, unsigned> remap;
+    // number the frames in the order of their first use (the unused frames are dropped)
+    const int frameCount = this->gfx->getFrameCount();
+    D1IndexRemap frameRemap(frameCount, -1);
     bool change = false;
-    unsigned idx = 1;
+    int idx = 0;
 
     for (int i = 0; i < this->min->getSubtileCount(); i++) {
-        QList<quint16> &frameIndices = this->min->getCelFrameIndices(i);
-        for (auto sit = frameIndices.begin(); sit != frameIndices.end(); ++sit) {
-            if (*sit == 0) {
+        const D1EntryView frameIndices = this->min->getCelFrameIndices(i);
+        for (quint16 frameRef : frameIndices) {
+            if (frameRef == 0 || frameRef > frameCount || frameRemap[frameRef - 1] >= 0) {
                 continue;
             }
-            auto mit = remap.find(*sit);
-            if (mit != remap.end()) {
-                *sit = mit.value();
-            } else {
-                remap[*sit] = idx;
-                change |= *sit != idx;
-                *sit = idx;
-                idx++;
-            }
+            frameRemap[frameRef - 1] = idx;
+            change |= frameRef - 1 != idx;
+            idx++;
         }
     }
-    QMap<unsigned, unsigned> backmap;
-    for (auto iter = remap.cbegin(); iter != remap.cend(); ++iter) {
-        backmap[iter.value()] = iter.key();
-    }
-    this->gfx->remapFrames(backmap);
+    this->min->remapFrameReferences(frameRemap);
+    this->gfx->remapFrames(frameRemap);
+    this->currentFrameIndex = std::max(0, std::min(this->currentFrameIndex, this->gfx->getFrameCount() - 1));
     return change;
 }
 
 bool LevelCelView::sortSubtiles_impl()
 {
-    QMap<unsigned, unsigned> remap;
+    // number the subtiles in the order of their first use (the unused subtiles are dropped)
+    const int subtileCount = this->min->getSubtileCount();
+    D1IndexRemap subtileRemap(subtileCount, -1);
     bool change = false;
-    unsigned idx = 0;
+    int idx = 0;
 
     for (int i = 0; i < this->til->getTileCount(); i++) {
-        QList<quint16> &subtileIndices = this->til->getSubtileIndices(i);
-        for (auto sit = subtileIndices.begin(); sit != subtileIndices.end(); ++sit) {
-            auto mit = remap.find(*sit);
-            if (mit != remap.end()) {
-                *sit = mit.value();
-            } else {
-                remap[*sit] = idx;
-                change |= *sit != idx;
-                *sit = idx;
-                idx++;
+        const D1EntryView subtileIndices = this->til->getSubtileIndices(i);
+        for (quint16 subtileRef : subtileIndices) {
+            if (subtileRef >= subtileCount || subtileRemap[subtileRef] >= 0) {
+                continue;
             }
+            subtileRemap[subtileRef] = idx;
+            change |= subtileRef != idx;
+            idx++;
         }
     }
-    QMap<unsigned, unsigned> backmap;
-    for (auto iter = remap.cbegin(); iter != remap.cend(); ++iter) {
-        backmap[iter.value()] = iter.key();
-    }
-    this->min->remapSubtiles(backmap);
-    this->sol->remapSubtiles(backmap);
+    this->til->remapSubtileReferences(subtileRemap);
+    this->min->remapSubtiles(subtileRemap);
+    this->sol->remapSubtiles(subtileRemap);
+    this->currentSubtileIndex = std::max(0, std::min(this->currentSubtileIndex, this->min->getSubtileCount() - 1));
     return change;
 }
 
@@ -1575,20 +1533,44 @@ void LevelCelView::sortSubtiles()
 
 void LevelCelView::displayFrame()
 {
-    quint16 minPosX = 0;
-    quint16 tilPosX = 0;
-
-    this->celScene->clear();
-
     // Getting the current frame/sub-tile/tile to display
-    QImage celFrame = this->gfx->getFrameImage(this->currentFrameIndex);
-    QImage subtile = this->min->getSubtileImage(this->currentSubtileIndex);
-    QImage tile = this->til->getTileImage(this->currentTileIndex);
+    this->celFrameImage = this->gfx->getFrameIndexedImage(this->currentFrameIndex);
+    this->celFrameImageIndex = this->currentFrameIndex;
+    this->subtileImage = this->min->getSubtileIndexedImage(this->currentSubtileIndex);
+    this->subtileImageIndex = this->currentSubtileIndex;
+    this->tileImage = this->til->getTileIndexedImage(this->currentTileIndex);
+    this->tileImageIndex = this->currentTileIndex;
 
     this->tabSubTileWidget->update();
     this->tabTileWidget->update();
     this->tabFrameWidget->update();
 
+    this->showFrameImages();
+}
+
+void LevelCelView::refreshPalette()
+{
+    // only the colors changed: update the color tables of the rendered images if possible
+    if (this->celFrameImageIndex != this->currentFrameIndex || this->subtileImageIndex != this->currentSubtileIndex || this->tileImageIndex != this->currentTileIndex
+        || !this->gfx->updateColorTable(this->celFrameImage) || !this->gfx->updateColorTable(this->subtileImage) || !this->gfx->updateColorTable(this->tileImage)) {
+        this->displayFrame();
+        return;
+    }
+
+    this->showFrameImages();
+}
+
+void LevelCelView::showFrameImages()
+{
+    quint16 minPosX = 0;
+    quint16 tilPosX = 0;
+
+    this->celScene->clear();
+
+    const QImage &celFrame = this->celFrameImage;
+    const QImage &subtile = this->subtileImage;
+    const QImage &tile = this->tileImage;
+
     // Resize the scene rectangle to include some padding around the CEL frame
     // the MIN subtile and the TIL tile
     this->celScene->setSceneRect(0, 0,
@@ -1669,9 +1651,8 @@ void LevelCelView::playGroup()
 {
     MainWindow *mw = (MainWindow *)this->window();
 
+    // the view is refreshed through the modified signal of the palette
     mw->nextPaletteCycle((D1PAL_CYCLE_TYPE)this->ui->playComboBox->currentIndex());
-
-    // this->displayFrame();
 }
 
 void LevelCelView::ShowContextMenu(const QPoint &pos)
@@ -1796,7 +1777,8 @@ void LevelCelView::on_firstFrameButton_clicked()
     this->currentFrameIndex = 0;
 
     if (this->mode == TILESET_MODE::SUBTILE) {
-        this->min->getCelFrameIndices(this->currentSubtileIndex)[this->editIndex] = this->currentFrameIndex + 1;
+        this->min->setCelFrameIndex(this->currentSubtileIndex, this->editIndex, this->currentFrameIndex + 1);
+        this->til->invalidateSubtile(this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1813,7 +1795,8 @@ void LevelCelView::on_previousFrameButton_clicked()
         this->currentFrameIndex = std::max(0, this->gfx->getFrameCount() - 1);
 
     if (this->mode == TILESET_MODE::SUBTILE) {
-        this->min->getCelFrameIndices(this->currentSubtileIndex)[this->editIndex] = this->currentFrameIndex + 1;
+        this->min->setCelFrameIndex(this->currentSubtileIndex, this->editIndex, this->currentFrameIndex + 1);
+        this->til->invalidateSubtile(this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1830,7 +1813,8 @@ void LevelCelView::on_nextFrameButton_clicked()
         this->currentFrameIndex = 0;
 
     if (this->mode == TILESET_MODE::SUBTILE) {
-        this->min->getCelFrameIndices(this->currentSubtileIndex)[this->editIndex] = this->currentFrameIndex + 1;
+        this->min->setCelFrameIndex(this->currentSubtileIndex, this->editIndex, this->currentFrameIndex + 1);
+        this->til->invalidateSubtile(this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1844,7 +1828,8 @@ void LevelCelView::on_lastFrameButton_clicked()
     this->currentFrameIndex = std::max(0, this->gfx->getFrameCount() - 1);
 
     if (this->mode == TILESET_MODE::SUBTILE) {
-        this->min->getCelFrameIndices(this->currentSubtileIndex)[this->editIndex] = this->currentFrameIndex + 1;
+        this->min->setCelFrameIndex(this->currentSubtileIndex, this->editIndex, this->currentFrameIndex + 1);
+        this->til->invalidateSubtile(this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1861,7 +1846,8 @@ void LevelCelView::on_frameIndexEdit_returnPressed()
         this->currentFrameIndex = frameIndex;
 
         if (this->mode == TILESET_MODE::SUBTILE) {
-            this->min->getCelFrameIndices(this->currentSubtileIndex)[this->editIndex] = this->currentFrameIndex + 1;
+            this->min->setCelFrameIndex(this->currentSubtileIndex, this->editIndex, this->currentFrameIndex + 1);
+            this->til->invalidateSubtile(this->currentSubtileIndex);
         } else {
             this->mode = TILESET_MODE::FREE;
             this->update();
@@ -1876,7 +1862,7 @@ void LevelCelView::on_firstSubtileButton_clicked()
     this->currentSubtileIndex = 0;
 
     if (this->mode == TILESET_MODE::TILE) {
-        this->til->getSubtileIndices(this->currentTileIndex)[this->editIndex] = this->currentSubtileIndex;
+        this->til->setSubtileIndex(this->currentTileIndex, this->editIndex, this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1893,7 +1879,7 @@ void LevelCelView::on_previousSubtileButton_clicked()
         this->currentSubtileIndex = std::max(0, this->min->getSubtileCount() - 1);
 
     if (this->mode == TILESET_MODE::TILE) {
-        this->til->getSubtileIndices(this->currentTileIndex)[this->editIndex] = this->currentSubtileIndex;
+        this->til->setSubtileIndex(this->currentTileIndex, this->editIndex, this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1910,7 +1896,7 @@ void LevelCelView::on_nextSubtileButton_clicked()
         this->currentSubtileIndex = 0;
 
     if (this->mode == TILESET_MODE::TILE) {
-        this->til->getSubtileIndices(this->currentTileIndex)[this->editIndex] = this->currentSubtileIndex;
+        this->til->setSubtileIndex(this->currentTileIndex, this->editIndex, this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1924,7 +1910,7 @@ void LevelCelView::on_lastSubtileButton_clicked()
     this->currentSubtileIndex = std::max(0, this->min->getSubtileCount() - 1);
 
     if (this->mode == TILESET_MODE::TILE) {
-        this->til->getSubtileIndices(this->currentTileIndex)[this->editIndex] = this->currentSubtileIndex;
+        this->til->setSubtileIndex(this->currentTileIndex, this->editIndex, this->currentSubtileIndex);
     } else {
         this->mode = TILESET_MODE::FREE;
         this->update();
@@ -1941,7 +1927,7 @@ void LevelCelView::on_subtileIndexEdit_returnPressed()
         this->currentSubtileIndex = subtileIndex;
 
         if (this->mode == TILESET_MODE::TILE) {
-            this->til->getSubtileIndices(this->currentTileIndex)[this->editIndex] = this->currentSubtileIndex;
+            this->til->setSubtileIndex(this->currentTileIndex, this->editIndex, this->currentSubtileIndex);
         } else {
             this->mode = TILESET_MODE::FREE;
             this->update();
@@ -100,11 +100,13 @@ public:
     void sortSubtiles();
 
     void displayFrame();
+    void refreshPalette();
 
     IMAGE_TYPE checkImageType(unsigned int x, unsigned int y);
 
 private:
     void update();
+    void showFrameImages();
     void collectFrameUsers(int frameIndex, QList<int> &users) const;
     void collectSubtileUsers(int subtileIndex, QList<int> &users) const;
     void insertFrames(IMAGE_FILE_MODE mode, const QStringList &imagefilePaths, bool append);
@@ -124,6 +126,7 @@ private:
     void removeUnusedSubtiles(QString &report);
     void reuseFrames(QString &report);
     void reuseSubtiles(QString &report);
+    void reuseTiles(QString &report);
     bool sortFrames_impl();
     bool sortSubtiles_impl();
 
@@ -199,4 +202,12 @@ private:
     quint16 currentPlayDelay = 50;
 
     QTimer playTimer;
+
+    // the last rendered (Indexed8) images of the current frame, sub-tile and tile
+    QImage celFrameImage;
+    QImage subtileImage;
+    QImage tileImage;
+    int celFrameImageIndex = -1;
+    int subtileImageIndex = -1;
+    int tileImageIndex = -1;
 };
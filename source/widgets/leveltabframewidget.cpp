@@ -54,11 +54,24 @@ static bool prepareMsgNonTransparent(QString &msg, int x, int y)
     return false;
 }
 
+// the pixels are read unchecked by the validators, so the frame must have the size of a micro
+static bool validSize(const D1GfxFrame *frame, QString &msg)
+{
+    if (frame->getWidth() == MICRO_WIDTH && frame->getHeight() == MICRO_HEIGHT)
+        return true;
+    msg = "Invalid frame size.";
+    return false;
+}
+
 static bool validSquare(const D1GfxFrame *frame, QString &msg, int *limit)
 {
+    if (!validSize(frame, msg))
+        return false;
     for (int y = 0; y < MICRO_HEIGHT; y++) {
+        if (frame->isRowOpaque(y))
+            continue;
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (frame->getPixel(x, y).isTransparent() && --*limit < 0) {
+            if (frame->isTransparent(x, y) && --*limit < 0) {
                 return prepareMsgTransparent(msg, x, y);
             }
         }
@@ -68,9 +81,11 @@ static bool validSquare(const D1GfxFrame *frame, QString &msg, int *limit)
 
 static bool validBottomLeftTriangle(const D1GfxFrame *frame, QString &msg, int *limit)
 {
+    if (!validSize(frame, msg))
+        return false;
     for (int y = MICRO_HEIGHT / 2; y < MICRO_HEIGHT; y++) {
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (frame->getPixel(x, y).isTransparent()) {
+            if (frame->isTransparent(x, y)) {
                 if (x >= (y * 2 - MICRO_WIDTH) && --*limit < 0) {
                     return prepareMsgTransparent(msg, x, y);
                 }
@@ -86,9 +101,11 @@ static bool validBottomLeftTriangle(const D1GfxFrame *frame, QString &msg, int *
 
 static bool validBottomRightTriangle(const D1GfxFrame *frame, QString &msg, int *limit)
 {
+    if (!validSize(frame, msg))
+        return false;
     for (int y = MICRO_HEIGHT / 2; y < MICRO_HEIGHT; y++) {
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (frame->getPixel(x, y).isTransparent()) {
+            if (frame->isTransparent(x, y)) {
                 if (x < (2 * MICRO_WIDTH - y * 2) && --*limit < 0) {
                     return prepareMsgTransparent(msg, x, y);
                 }
@@ -109,7 +126,7 @@ static bool validLeftTriangle(const D1GfxFrame *frame, QString &msg, int *limit)
     }
     for (int y = 0; y < MICRO_HEIGHT / 2; y++) {
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (frame->getPixel(x, y).isTransparent()) {
+            if (frame->isTransparent(x, y)) {
                 if (x >= (MICRO_WIDTH - y * 2) && --*limit < 0) {
                     return prepareMsgTransparent(msg, x, y);
                 }
@@ -130,7 +147,7 @@ static bool validRightTriangle(const D1GfxFrame *frame, QString &msg, int *limit
     }
     for (int y = 0; y < MICRO_HEIGHT / 2; y++) {
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (frame->getPixel(x, y).isTransparent()) {
+            if (frame->isTransparent(x, y)) {
                 if (x < y * 2 && --*limit < 0) {
                     return prepareMsgTransparent(msg, x, y);
                 }
@@ -146,9 +163,13 @@ static bool validRightTriangle(const D1GfxFrame *frame, QString &msg, int *limit
 
 static bool validTopHalfSquare(const D1GfxFrame *frame, QString &msg, int *limit)
 {
+    if (!validSize(frame, msg))
+        return false;
     for (int y = 0; y < MICRO_HEIGHT / 2; y++) {
+        if (frame->isRowOpaque(y))
+            continue;
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (frame->getPixel(x, y).isTransparent() && --*limit < 0) {
+            if (frame->isTransparent(x, y) && --*limit < 0) {
                 return prepareMsgTransparent(msg, x, y);
             }
         }
@@ -168,9 +189,13 @@ static bool validRightTrapezoid(const D1GfxFrame *frame, QString &msg, int *limi
 
 static bool validEmpty(const D1GfxFrame *frame, QString &msg, int *limit)
 {
+    if (!validSize(frame, msg))
+        return false;
     for (int y = 0; y < MICRO_HEIGHT; y++) {
+        if (frame->isRowTransparent(y))
+            continue;
         for (int x = 0; x < MICRO_WIDTH; x++) {
-            if (!frame->getPixel(x, y).isTransparent() && --*limit < 0) {
+            if (!frame->isTransparent(x, y) && --*limit < 0) {
                 return prepareMsgNonTransparent(msg, x, y);
             }
         }
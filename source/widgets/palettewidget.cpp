@@ -779,7 +779,7 @@ bool PaletteWidget::displayColor(int colorIndex)
     switch (this->palHits->getMode()) {
     case D1PALHITS_MODE::ALL_COLORS:
     case D1PALHITS_MODE::ALL_FRAMES:
-        return this->palHits->getIndexHits(colorIndex, 0) != 0;
+        return this->palHits->isIndexUsed(colorIndex, 0);
     case D1PALHITS_MODE::CURRENT_TILE:
         itemIndex = this->levelCelView->getCurrentTileIndex();
         break;
@@ -791,7 +791,7 @@ bool PaletteWidget::displayColor(int colorIndex)
         break;
     }
 
-    return this->palHits->getIndexHits(colorIndex, itemIndex) != 0;
+    return this->palHits->isIndexUsed(colorIndex, itemIndex);
 }
 
 void PaletteWidget::displayColors()